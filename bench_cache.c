@@ -0,0 +1,78 @@
+/* HTTP client for benchmarking the file cache.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "bench_client.h"
+
+/* Usage: bench_cache PORT NR_FILES NR_REQUESTS
+ *
+ * Fetches /bench/0.html ... /bench/NR_FILES-1.html from 127.0.0.1:PORT
+ * in turn, over a persistent connection, and prints the time taken per
+ * request. If NR_FILES is more than 'file cache entries', every request
+ * misses the cache and evicts an entry (see bench_cache.sh).
+ */
+
+int
+main (int argc, char *argv[])
+{
+  int port, nr_files, nr_requests, sock, i, len, reconnects = 0;
+  char req[256];
+  double start, t;
+
+  if (argc != 4)
+    {
+      fprintf (stderr, "usage: bench_cache PORT NR_FILES NR_REQUESTS\n");
+      exit (1);
+    }
+  port = atoi (argv[1]);
+  nr_files = atoi (argv[2]);
+  nr_requests = atoi (argv[3]);
+
+  sock = bench_connect (port);
+  start = bench_now ();
+  for (i = 0; i < nr_requests; ++i)
+    {
+      len = snprintf (req, sizeof req,
+		      "GET /bench/%d.html HTTP/1.1\r\n"
+		      "Host: localhost:%d\r\n\r\n",
+		      i % nr_files, port);
+      bench_write (sock, req, len);
+      if (bench_read_response (sock))
+	{
+	  close (sock);
+	  sock = bench_connect (port);
+	  reconnects++;
+	}
+    }
+  t = bench_now () - start;
+  close (sock);
+
+  printf ("%d files: %.1f us/request (%d reconnects)\n",
+	  nr_files, t * 1e6 / nr_requests, reconnects);
+  return 0;
+}
@@ -0,0 +1,99 @@
+#!/bin/sh -
+#
+# Measures the cost of file cache evictions (see bench_cache.c).
+# - by agent <agent@local>
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Library General Public
+# License as published by the Free Software Foundation; either
+# version 2 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Library General Public License for more details.
+#
+# You should have received a copy of the GNU Library General Public
+# License along with this library; if not, write to the Free
+# Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+#
+# $Id$
+#
+# For each cache size N, rwsd is started with 'file cache entries: N'
+# and 2N files are fetched in turn, so that every request misses the
+# cache and evicts the least recently used file. If eviction is O(1)
+# the time per request should not grow with N.
+
+# A random, hopefully free, port.
+port=14137
+
+requests=${REQUESTS:-20000}
+sizes=${SIZES:-"100 1000 10000 100000"}
+
+tmp=/tmp/rws-bench.$$
+rm -rf $tmp
+mkdir -p $tmp/etc/rws/hosts $tmp/log $tmp/html/bench
+
+cat > $tmp/etc/rws/hosts/default <<EOF
+alias /
+	path:	$tmp/html
+end alias
+EOF
+(cd $tmp/etc/rws/hosts; ln -s default localhost:$port)
+
+cat > $tmp/etc/mime.types <<EOF
+text/html html
+EOF
+
+# Create enough files for the largest cache.
+max=0
+for n in $sizes; do
+	if [ $n -gt $max ]; then max=$n; fi
+done
+i=0
+while [ $i -lt $((2 * $max)) ]; do
+	echo "<html><body>File $i.</body></html>" > $tmp/html/bench/$i.html
+	i=$(($i + 1))
+done
+
+# Each cached file is a separate mapping, and Linux limits how many a
+# process may have.
+if [ -r /proc/sys/vm/max_map_count ] &&
+   [ `cat /proc/sys/vm/max_map_count` -le $max ]; then
+	echo "vm.max_map_count is too low for $max cached files, so the"
+	echo "largest caches won't fill. Raise it with sysctl first."
+fi
+
+for n in $sizes; do
+	cat > $tmp/etc/rws/rws.conf <<EOF
+mime types file: $tmp/etc/mime.types
+error log: $tmp/log/error_log
+access log: /dev/null
+file cache entries: $n
+stat cache entries: $((4 * $max))
+route cache entries: $((4 * $max))
+EOF
+
+	./rwsd -p $port -f -a 127.0.0.1 -C $tmp/etc/rws &
+	rws_pid=$!; sleep 1
+
+	if kill -0 $rws_pid; then :;
+	else
+		echo "Server did not start up. Check any preceeding messages."
+		rm -rf $tmp
+		exit 1
+	fi
+
+	# Fill the cache once, then measure.
+	./bench_cache $port $((2 * $n)) $((2 * $n)) >/dev/null &&
+	./bench_cache $port $((2 * $n)) $requests
+	status=$?
+
+	kill $rws_pid; wait $rws_pid 2>/dev/null
+	if [ $status -ne 0 ]; then rm -rf $tmp; exit 1; fi
+done
+
+# Remove the temporary directory.
+rm -rf $tmp
+
+exit 0
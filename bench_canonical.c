@@ -0,0 +1,95 @@
+/* Microbenchmark for canonicalize_path.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+#include <pool.h>
+
+#include "canonical.h"
+#include "old_canonical.h"
+
+/* Run with 'make bench'. This compares canonicalize_path with the way
+ * request paths were canonicalized before it existed (old_canonical.c),
+ * in a per-request pool. test_canonical checks that they agree.
+ */
+
+static const char *paths[] = {
+  "/",
+  "/index.html",
+  "/icons/text.gif",
+  "/docs/manual/chapter01/section%202.html",
+  "/a/./b/../c//d/",
+  "/so-bin/show_params.so",
+  "/download/releases/2003/rws-1.2.0.tar.gz",
+  "/%7Erich/pub/../notes/",
+};
+#define NR_PATHS (sizeof paths / sizeof paths[0])
+
+static double
+now ()
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+int
+main (int argc, char *argv[])
+{
+  int iterations = argc > 1 ? atoi (argv[1]) : 1000000;
+  int comps[MAX_PATH_COMPS];
+  char buf[256];
+  double start, t_old, t_new;
+  pool pool;
+  int i;
+
+  start = now ();
+  for (i = 0; i < iterations; ++i)
+    {
+      pool = new_subpool (global_pool);
+      old_canonicalize (pool, paths[i % NR_PATHS]);
+      delete_pool (pool);
+    }
+  t_old = now () - start;
+
+  start = now ();
+  for (i = 0; i < iterations; ++i)
+    {
+      strcpy (buf, paths[i % NR_PATHS]);
+      canonicalize_path (buf, 1, comps, MAX_PATH_COMPS);
+    }
+  t_new = now () - start;
+
+  printf ("split and join:    %8.1f ns/path\n", t_old * 1e9 / iterations);
+  printf ("canonicalize_path: %8.1f ns/path\n", t_new * 1e9 / iterations);
+  return 0;
+}
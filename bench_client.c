@@ -0,0 +1,137 @@
+/* HTTP client functions shared by the benchmarks.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+
+#ifdef HAVE_ARPA_INET_H
+#include <arpa/inet.h>
+#endif
+
+#include "bench_client.h"
+
+double
+bench_now ()
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+int
+bench_connect (int port)
+{
+  struct sockaddr_in addr;
+  int sock;
+
+  sock = socket (AF_INET, SOCK_STREAM, 0);
+  if (sock == -1) { perror ("socket"); exit (1); }
+
+  memset (&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons (port);
+  addr.sin_addr.s_addr = inet_addr ("127.0.0.1");
+  if (connect (sock, (struct sockaddr *) &addr, sizeof addr) == -1)
+    { perror ("connect"); exit (1); }
+
+  return sock;
+}
+
+void
+bench_write (int sock, const char *buf, int len)
+{
+  if (write (sock, buf, len) != len) { perror ("write"); exit (1); }
+}
+
+int
+bench_read_response (int sock)
+{
+  static char buf[65536];
+  static int used = 0;
+  char *end, *h;
+  long length = -1;
+  int n, close = 0;
+
+  /* Read the headers. */
+  for (;;)
+    {
+      buf[used] = '\0';
+      if ((end = strstr (buf, "\r\n\r\n")) != 0) break;
+      n = read (sock, buf + used, sizeof buf - 1 - used);
+      if (n <= 0) { fprintf (stderr, "bench: short response\n"); exit (1); }
+      used += n;
+    }
+  end += 4;
+
+  if (strncmp (buf, "HTTP/1.1 200", 12) != 0 &&
+      strncmp (buf, "HTTP/1.0 200", 12) != 0)
+    {
+      fprintf (stderr, "bench: bad response: %.*s\n",
+	       (int) strcspn (buf, "\r"), buf);
+      exit (1);
+    }
+  for (h = buf; h < end; h = strstr (h, "\r\n") + 2)
+    {
+      if (strncasecmp (h, "Content-Length:", 15) == 0)
+	length = atol (h + 15);
+      else if (strncasecmp (h, "Connection: close", 17) == 0)
+	close = 1;
+    }
+  if (length < 0)
+    { fprintf (stderr, "bench: no Content-Length\n"); exit (1); }
+
+  /* Skip the body. */
+  used -= end - buf;
+  memmove (buf, end, used);
+  while (used < length)
+    {
+      length -= used;
+      used = read (sock, buf, sizeof buf - 1);
+      if (used <= 0) { fprintf (stderr, "bench: short body\n"); exit (1); }
+    }
+  used -= length;
+  memmove (buf, buf + length, used);
+
+  if (close) used = 0;
+  return close;
+}
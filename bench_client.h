@@ -0,0 +1,41 @@
+/* HTTP client functions shared by the benchmarks.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#ifndef BENCH_CLIENT_H
+#define BENCH_CLIENT_H
+
+/* The current time in seconds. */
+extern double bench_now (void);
+
+/* Connect to 127.0.0.1:PORT. Exits on error. */
+extern int bench_connect (int port);
+
+/* Write all of BUF to SOCK in one write(2) call. Exits on error. */
+extern void bench_write (int sock, const char *buf, int len);
+
+/* Read one response from SOCK, which must be a 200 response with a
+ * Content-Length. Anything read after the end of the response is kept
+ * for the next call, so only one connection at a time may be read.
+ * Exits on error. Returns 1 if the server will close the connection,
+ * else 0.
+ */
+extern int bench_read_response (int sock);
+
+#endif /* BENCH_CLIENT_H */
@@ -0,0 +1,169 @@
+#!/bin/sh -
+#
+# Measures how long rwsd takes to load its configuration, from the text
+# files and from the compiled image.
+# - by agent <agent@local>
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Library General Public
+# License as published by the Free Software Foundation; either
+# version 2 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Library General Public License for more details.
+#
+# You should have received a copy of the GNU Library General Public
+# License along with this library; if not, write to the Free
+# Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+#
+# $Id$
+#
+# For each number of hosts N (10, 1000 and 10000 by default), a hosts
+# directory with N files is generated. rwsd is started from the text
+# files, and then from an image made with 'rwsd --compile-config'. Each
+# time this prints how long rwsd took to start answering requests, and
+# the time it took to load the configuration at startup and on SIGHUP,
+# as shown on the server status page. Set RELOADS to change the number
+# of SIGHUPs, whose times are averaged.
+
+# A random, hopefully free, port.
+port=14141
+
+rwsd=${RWSD:-./rwsd}
+sizes=${SIZES:-"10 1000 10000"}
+reloads=${RELOADS:-5}
+
+# The status page is fetched with 'curl' or 'wget'.
+curl --help >/dev/null 2>&1
+if [ $? -eq 0 ]; then
+	fetch="curl -s -H Host:localhost:$port"
+else
+	wget --help >/dev/null 2>&1
+	if [ $? -eq 0 ]; then
+		fetch="wget -q -O - --header=Host:localhost:$port"
+	else
+		echo "Please install either 'curl' or 'wget'."
+		echo "This benchmark did not run."
+		exit 0
+	fi
+fi
+
+tmp=/tmp/rws-bench.$$
+rm -rf $tmp
+mkdir -p $tmp/log $tmp/html
+
+cat > $tmp/mime.types <<EOF
+text/html html
+EOF
+
+# Milliseconds since the epoch.
+now () {
+	date +%s%N | awk '{ printf "%.1f", $1 / 1e6 }'
+}
+
+# Print the value of a line from the text status page.
+get_status () {
+	$fetch http://127.0.0.1:$port/server-status 2>/dev/null |
+	  awk -F': ' '$1 == "'"$1"'" { print $2 + 0 }'
+}
+
+# Wait until rwsd has loaded the configuration N times.
+wait_for_loads () {
+	tries=0
+	while [ "`get_status 'configuration loads'`" != $1 ]; do
+		sleep 0.01
+		tries=$(($tries + 1))
+		if [ $tries -gt 6000 ]; then
+			echo "Timed out waiting for the configuration to load."
+			return 1
+		fi
+	done
+	return 0
+}
+
+status=0
+for n in $sizes; do
+	conf=$tmp/etc.$n
+	mkdir -p $conf/hosts
+
+	cat > $conf/rws.conf <<EOF
+mime types file: $tmp/mime.types
+error log: $tmp/log/error_log
+access log: /dev/null
+EOF
+
+	cat > $conf/hosts/default <<EOF
+server status: /server-status
+alias /
+	path:	$tmp/html
+end alias
+EOF
+	(cd $conf/hosts; ln -s default localhost:$port)
+
+	# The other hosts look like the example in conf/default.
+	i=1
+	while [ $i -lt $n ]; do
+		cat > $conf/hosts/host$i.example.com <<EOF
+maintainer:	webmaster@host$i.example.com
+alias /
+	path:		/var/www/host$i
+	show:		1
+	list:		1
+end alias
+alias /cgi-bin/
+	path:		/var/www/host$i/cgi-bin
+	exec:		1
+end alias
+alias /so-bin/
+	path:		/var/www/host$i/so-bin
+	exec so:	1
+end alias
+EOF
+		i=$(($i + 1))
+	done
+
+	for mode in text image; do
+		if [ $mode = image ]; then
+			start=`now`
+			$rwsd --compile-config -C $conf || { status=1; break; }
+			end=`now`
+			echo "$n hosts: compiling the image took" \
+			  `echo $start $end | awk '{ print $2 - $1 }'` ms
+		fi
+
+		start=`now`
+		$rwsd -p $port -f -a 127.0.0.1 -C $conf &
+		rws_pid=$!
+
+		wait_for_loads 1 || { status=1; kill $rws_pid; break; }
+		ready=`now`
+		load=`get_status 'last configuration load'`
+
+		total=0
+		i=1
+		while [ $i -le $reloads ]; do
+			kill -HUP $rws_pid
+			wait_for_loads $(($i + 1)) || { status=1; break; }
+			total=$(($total + `get_status 'last configuration load'`))
+			i=$(($i + 1))
+		done
+
+		kill $rws_pid; wait $rws_pid 2>/dev/null
+		if [ $status -ne 0 ]; then break; fi
+
+		echo $start $ready $load $total $reloads |
+		  awk -v n=$n -v mode=$mode '{
+			printf "%5d hosts, %-5s: ready after %.1f ms, " \
+			  "load %.1f ms, reload %.1f ms\n",
+			  n, mode, $2 - $1, $3 / 1000, $4 / $5 / 1000
+		  }'
+	done
+	if [ $status -ne 0 ]; then break; fi
+done
+
+# Remove the temporary directory.
+rm -rf $tmp
+
+exit $status
@@ -0,0 +1,150 @@
+/* HTTP client for benchmarking with many idle connections.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/resource.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#include "bench_client.h"
+
+/* Usage: bench_idle PORT PATH NR_IDLE NR_REQUESTS
+ *
+ * Opens NR_IDLE connections to 127.0.0.1:PORT and fetches PATH once on
+ * each, so that they become idle keep-alive connections. Then fetches
+ * PATH NR_REQUESTS times, one after another, on one more connection,
+ * and prints the mean, median and 99th percentile time per request.
+ * Finally it counts how many of the idle connections the server has
+ * closed meanwhile (see bench_idle.sh).
+ */
+
+static int
+compare_doubles (const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+
+  return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static void
+fetch (int sock, const char *req, int len)
+{
+  bench_write (sock, req, len);
+  if (bench_read_response (sock))
+    {
+      fprintf (stderr, "bench_idle: server closed the connection\n");
+      exit (1);
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  int port, nr_idle, nr_requests, sock, *idle, i, r, len, closed = 0;
+  const char *path;
+  char req[256], c;
+  double *times, start, total = 0;
+  struct rlimit rl;
+
+  if (argc != 5)
+    {
+      fprintf (stderr, "usage: bench_idle PORT PATH NR_IDLE NR_REQUESTS\n");
+      exit (1);
+    }
+  port = atoi (argv[1]);
+  path = argv[2];
+  nr_idle = atoi (argv[3]);
+  nr_requests = atoi (argv[4]);
+  if (nr_idle < 0 || nr_requests < 1)
+    {
+      fprintf (stderr, "bench_idle: bad NR_IDLE or NR_REQUESTS\n");
+      exit (1);
+    }
+
+  /* Make sure there are enough file descriptors. */
+  if (getrlimit (RLIMIT_NOFILE, &rl) == -1)
+    { perror ("getrlimit"); exit (1); }
+  if (rl.rlim_cur < nr_idle + 16)
+    {
+      rl.rlim_cur = nr_idle + 16;
+      if (setrlimit (RLIMIT_NOFILE, &rl) == -1)
+	{
+	  perror ("setrlimit: too many idle connections");
+	  exit (1);
+	}
+    }
+
+  len = snprintf (req, sizeof req,
+		  "GET %s HTTP/1.1\r\n"
+		  "Host: localhost:%d\r\n\r\n", path, port);
+
+  idle = malloc ((nr_idle + 1) * sizeof (int));
+  times = malloc (nr_requests * sizeof (double));
+  if (idle == 0 || times == 0) { perror ("malloc"); exit (1); }
+
+  for (i = 0; i < nr_idle; ++i)
+    {
+      idle[i] = bench_connect (port);
+      fetch (idle[i], req, len);
+    }
+
+  sock = bench_connect (port);
+  for (i = 0; i < nr_requests; ++i)
+    {
+      start = bench_now ();
+      fetch (sock, req, len);
+      times[i] = bench_now () - start;
+      total += times[i];
+    }
+  close (sock);
+
+  /* A closed connection reads end of file, or an error if it was
+   * reset. An open one has nothing to read.
+   */
+  for (i = 0; i < nr_idle; ++i)
+    {
+      r = recv (idle[i], &c, 1, MSG_PEEK | MSG_DONTWAIT);
+      if (r == 0 || (r == -1 && errno != EAGAIN && errno != EWOULDBLOCK))
+	closed++;
+      close (idle[i]);
+    }
+
+  qsort (times, nr_requests, sizeof (double), compare_doubles);
+  printf ("%5d idle: mean %.1f us, median %.1f us, 99%% %.1f us "
+	  "(%d idle closed)\n",
+	  nr_idle, total * 1e6 / nr_requests,
+	  times[nr_requests / 2] * 1e6,
+	  times[nr_requests * 99 / 100] * 1e6,
+	  closed);
+
+  free (idle);
+  free (times);
+  return 0;
+}
@@ -0,0 +1,98 @@
+#!/bin/sh -
+#
+# Measures whether idle keep-alive connections slow down busy ones (see
+# bench_idle.c).
+# - by agent <agent@local>
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Library General Public
+# License as published by the Free Software Foundation; either
+# version 2 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Library General Public License for more details.
+#
+# You should have received a copy of the GNU Library General Public
+# License along with this library; if not, write to the Free
+# Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+#
+# $Id$
+#
+# For each number of idle connections N (0 and 10000 by default), rwsd
+# is started afresh, bench_idle leaves N keep-alive connections idle,
+# and then times REQUESTS requests for a small cached file on one more
+# connection. 'keepalive timeout' is long and 'max idle connections'
+# is unlimited, so none of the idle connections should be closed.
+# Set RWSD to run a different binary, for example one built from
+# before idle connections were parked in epoll.
+
+# A random, hopefully free, port.
+port=14140
+
+rwsd=${RWSD:-./rwsd}
+idle=${IDLE:-"0 10000"}
+requests=${REQUESTS:-10000}
+
+# Both rwsd and bench_idle need a file descriptor per connection.
+max=0
+for n in $idle; do
+	if [ $n -gt $max ]; then max=$n; fi
+done
+if [ `ulimit -n` != unlimited ] && [ `ulimit -n` -lt $(($max + 100)) ]; then
+	ulimit -n $(($max + 100)) || {
+		echo "Raise the hard limit on open files above $(($max + 100))."
+		echo "This benchmark did not run."
+		exit 0
+	}
+fi
+
+tmp=/tmp/rws-bench.$$
+rm -rf $tmp
+mkdir -p $tmp/etc/rws/hosts $tmp/log $tmp/html
+
+cat > $tmp/etc/rws/hosts/default <<EOF
+alias /
+	path:	$tmp/html
+end alias
+EOF
+(cd $tmp/etc/rws/hosts; ln -s default localhost:$port)
+
+cat > $tmp/etc/mime.types <<EOF
+text/html html
+EOF
+
+cat > $tmp/etc/rws/rws.conf <<EOF
+mime types file: $tmp/etc/mime.types
+error log: $tmp/log/error_log
+access log: /dev/null
+keepalive timeout: 3600
+max idle connections: 0
+EOF
+
+echo "<html><body>Small file.</body></html>" > $tmp/html/small.html
+
+status=0
+for n in $idle; do
+	$rwsd -p $port -f -a 127.0.0.1 -C $tmp/etc/rws &
+	rws_pid=$!; sleep 1
+
+	if kill -0 $rws_pid; then :;
+	else
+		echo "Server did not start up. Check any preceeding messages."
+		rm -rf $tmp
+		exit 1
+	fi
+
+	./bench_idle $port /small.html $n $requests
+	status=$?
+
+	kill $rws_pid; wait $rws_pid 2>/dev/null
+	if [ $status -ne 0 ]; then break; fi
+done
+
+# Remove the temporary directory.
+rm -rf $tmp
+
+exit $status
@@ -0,0 +1,199 @@
+/* Microbenchmark for the file cache LRU list.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+#include <pool.h>
+#include <vector.h>
+
+#include "lru.h"
+
+/* Run with 'make bench'. This fills a cache of N entries and then
+ * measures the cost of the list operations which make_room and
+ * add_entry in file.c do for each eviction: find the oldest entry,
+ * free its slot, and take a slot for the new entry. It compares the
+ * LRU list with the way the cache worked before it existed: a vector
+ * of offsets in FIFO order, which invalidate_entry searched and erased
+ * from, and a linear scan of file_list for a blank entry. Unmapping
+ * the file and updating the hash are the same either way, and are not
+ * included.
+ */
+
+static const int sizes[] = { 100, 1000, 10000, 100000 };
+#define NR_SIZES (sizeof sizes / sizeof sizes[0])
+
+/* Each measurement runs for at least this long, and for at least N
+ * evictions, so that every slot has been evicted once.
+ */
+#define MIN_TIME 0.5
+
+/* An entry in file_list, as it was. */
+struct old_file_info
+{
+  struct pool *pool;
+  struct stat statbuf;
+  void *addr;
+};
+
+static double
+now ()
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void
+old_evict_and_add (vector file_list, vector lru_list)
+{
+  struct old_file_info info, entry;
+  int offset, i, j;
+
+  /* Evict the oldest entry (invalidate_entry). */
+  vector_get (lru_list, 0, offset);
+  for (i = 0; i < vector_size (lru_list); ++i)
+    {
+      vector_get (lru_list, i, j);
+      if (j == offset)
+	{
+	  vector_erase (lru_list, i);
+	  break;
+	}
+    }
+  vector_get (file_list, offset, info);
+  info.pool = 0;
+  vector_replace (file_list, offset, info);
+
+  /* Add the new entry in the first blank entry. */
+  info.pool = global_pool;
+  for (offset = 0; offset < vector_size (file_list); ++offset)
+    {
+      vector_get (file_list, offset, entry);
+      if (entry.pool == 0)
+	{
+	  vector_replace (file_list, offset, info);
+	  break;
+	}
+    }
+  if (offset == vector_size (file_list))
+    vector_push_back (file_list, info);
+  vector_push_back (lru_list, offset);
+}
+
+static double
+time_old (int n)
+{
+  pool pool = new_subpool (global_pool);
+  vector file_list = new_vector (pool, struct old_file_info);
+  vector lru_list = new_vector (pool, int);
+  struct old_file_info info;
+  double start, t;
+  long ops = 0;
+  int i;
+
+  memset (&info, 0, sizeof info);
+  info.pool = pool;
+  for (i = 0; i < n; ++i)
+    {
+      vector_push_back (file_list, info);
+      vector_push_back (lru_list, i);
+    }
+
+  start = now ();
+  do
+    {
+      for (i = 0; i < 16; ++i)
+	old_evict_and_add (file_list, lru_list);
+      ops += 16;
+    }
+  while ((t = now () - start) < MIN_TIME || ops < n);
+
+  delete_pool (pool);
+  return t * 1e9 / ops;
+}
+
+static double
+time_lru (int n, int touch)
+{
+  pool pool = new_subpool (global_pool);
+  lru lru = new_lru (pool);
+  double start, t;
+  long ops = 0;
+  int i, slot;
+
+  for (i = 0; i < n; ++i)
+    lru_new_slot (lru);
+
+  start = now ();
+  do
+    {
+      for (i = 0; i < 16; ++i)
+	{
+	  if (touch)		/* A cache hit on the second oldest entry. */
+	    lru_touch (lru, lru_next (lru, lru_oldest (lru)));
+	  else			/* A miss, which evicts the oldest. */
+	    {
+	      slot = lru_oldest (lru);
+	      lru_free_slot (lru, slot);
+	      lru_new_slot (lru);
+	    }
+	}
+      ops += 16;
+    }
+  while ((t = now () - start) < MIN_TIME || ops < n);
+
+  delete_pool (pool);
+  return t * 1e9 / ops;
+}
+
+int
+main (int argc, char *argv[])
+{
+  int i;
+
+  printf ("%8s %14s %14s %14s\n",
+	  "entries", "old evict", "LRU evict", "LRU hit");
+  for (i = 0; i < NR_SIZES; ++i)
+    printf ("%8d %11.1f ns %11.1f ns %11.1f ns\n",
+	    sizes[i], time_old (sizes[i]),
+	    time_lru (sizes[i], 0), time_lru (sizes[i], 1));
+
+  return 0;
+}
@@ -0,0 +1,93 @@
+/* HTTP client for benchmarking pipelined requests.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "bench_client.h"
+
+/* Usage: bench_pipeline PORT PATH BATCH NR_REQUESTS
+ *
+ * Fetches PATH from 127.0.0.1:PORT NR_REQUESTS times over a persistent
+ * connection, sending the requests in batches of BATCH with one
+ * write(2) per batch and then reading the BATCH responses. Prints the
+ * time taken per request. bench_pipeline.sh counts the server's
+ * writes while this runs.
+ */
+
+int
+main (int argc, char *argv[])
+{
+  int port, batch, nr_requests, sock, i, len, n;
+  const char *path;
+  char *req;
+  double start, t;
+
+  if (argc != 5)
+    {
+      fprintf (stderr,
+	       "usage: bench_pipeline PORT PATH BATCH NR_REQUESTS\n");
+      exit (1);
+    }
+  port = atoi (argv[1]);
+  path = argv[2];
+  batch = atoi (argv[3]);
+  nr_requests = atoi (argv[4]);
+  if (batch < 1 || nr_requests < batch)
+    {
+      fprintf (stderr, "bench_pipeline: bad BATCH or NR_REQUESTS\n");
+      exit (1);
+    }
+
+  /* Make the batch of requests. */
+  req = malloc (batch * (snprintf (0, 0, "GET %s HTTP/1.1\r\n"
+				   "Host: localhost:%d\r\n\r\n",
+				   path, port) + 1));
+  if (req == 0) { perror ("malloc"); exit (1); }
+  for (i = 0, len = 0; i < batch; ++i)
+    len += sprintf (req + len, "GET %s HTTP/1.1\r\n"
+		    "Host: localhost:%d\r\n\r\n", path, port);
+
+  sock = bench_connect (port);
+  start = bench_now ();
+  for (n = 0; n + batch <= nr_requests; n += batch)
+    {
+      bench_write (sock, req, len);
+      for (i = 0; i < batch; ++i)
+	if (bench_read_response (sock))
+	  {
+	    fprintf (stderr, "bench_pipeline: server closed the "
+		     "connection after %d requests\n", n + i + 1);
+	    exit (1);
+	  }
+    }
+  t = bench_now () - start;
+  close (sock);
+  free (req);
+
+  printf ("batch %3d: %.1f us/request\n", batch, t * 1e6 / n);
+  return 0;
+}
@@ -0,0 +1,131 @@
+#!/bin/sh -
+#
+# Counts the writes rwsd makes for pipelined requests (see
+# bench_pipeline.c).
+# - by agent <agent@local>
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Library General Public
+# License as published by the Free Software Foundation; either
+# version 2 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Library General Public License for more details.
+#
+# You should have received a copy of the GNU Library General Public
+# License along with this library; if not, write to the Free
+# Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+#
+# $Id$
+#
+# A small cached file is fetched REQUESTS times in batches of 1, 10
+# and 100 pipelined requests. For each batch size this prints the time
+# per request and the number of calls rwsd made per request to write
+# to its sockets and logs. The calls are counted with 'strace -c -f' if
+# it is installed, or else from syscw in /proc/PID/io, which counts
+# write(2), writev(2) and sendfile(2) but not send(2). Set RWSD to run
+# a different binary, for example one built from before responses were
+# batched.
+
+# A random, hopefully free, port.
+port=14138
+
+rwsd=${RWSD:-./rwsd}
+requests=${REQUESTS:-10000}
+batches=${BATCHES:-"1 10 100"}
+
+strace -V >/dev/null 2>&1
+if [ $? -eq 0 ]; then
+	mode=strace
+elif [ -r /proc/self/io ]; then
+	mode=syscw
+else
+	echo "Please install 'strace', or use a kernel with /proc/PID/io."
+	echo "This benchmark did not run."
+	exit 0
+fi
+
+echo "Using $mode to count writes."
+
+tmp=/tmp/rws-bench.$$
+rm -rf $tmp
+mkdir -p $tmp/etc/rws/hosts $tmp/log $tmp/html
+
+cat > $tmp/etc/rws/hosts/default <<EOF
+alias /
+	path:	$tmp/html
+end alias
+EOF
+(cd $tmp/etc/rws/hosts; ln -s default localhost:$port)
+
+cat > $tmp/etc/mime.types <<EOF
+text/html html
+EOF
+
+cat > $tmp/etc/rws/rws.conf <<EOF
+mime types file: $tmp/etc/mime.types
+error log: $tmp/log/error_log
+access log: /dev/null
+EOF
+
+echo "<html><body>Small file.</body></html>" > $tmp/html/small.html
+
+$rwsd -p $port -f -a 127.0.0.1 -C $tmp/etc/rws &
+rws_pid=$!; sleep 1
+
+if kill -0 $rws_pid; then :;
+else
+	echo "Server did not start up. Check any preceeding messages."
+	rm -rf $tmp
+	exit 1
+fi
+
+syscw () {
+	awk '$1 == "syscw:" { print $2 }' /proc/$rws_pid/io
+}
+
+# Run the client with its arguments, and put the number of writes
+# rwsd made while it ran in $tmp/writes.
+count_writes () {
+	if [ $mode = strace ]; then
+		strace -c -f -o $tmp/strace -p $rws_pid \
+		  -e trace=write,writev,sendfile,send,sendto,sendmsg &
+		strace_pid=$!; sleep 1
+		./bench_pipeline $port /small.html "$@"
+		status=$?
+		kill -INT $strace_pid; wait $strace_pid
+		awk '$NF == "total" { print $4 }' $tmp/strace > $tmp/writes
+	else
+		before=`syscw`
+		./bench_pipeline $port /small.html "$@"
+		status=$?
+		after=`syscw`
+		expr $after - $before > $tmp/writes
+	fi
+	return $status
+}
+
+# Put the file into the cache.
+./bench_pipeline $port /small.html 1 1 >/dev/null
+status=$?
+
+for b in $batches; do
+	if [ $status -ne 0 ]; then break; fi
+
+	count_writes $b $requests
+	status=$?
+	if [ $status -eq 0 ]; then
+		awk -v b=$b -v n=$requests \
+		  '{ printf "batch %3d: %.2f writes/request\n", b, $1 / n }' \
+		  $tmp/writes
+	fi
+done
+
+kill $rws_pid; wait $rws_pid 2>/dev/null
+
+# Remove the temporary directory.
+rm -rf $tmp
+
+exit $status
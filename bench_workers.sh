@@ -0,0 +1,107 @@
+#!/bin/sh -
+#
+# Measures how throughput changes with the number of worker processes.
+# - by agent <agent@local>
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Library General Public
+# License as published by the Free Software Foundation; either
+# version 2 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Library General Public License for more details.
+#
+# You should have received a copy of the GNU Library General Public
+# License along with this library; if not, write to the Free
+# Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+#
+# $Id$
+#
+# For 1, 2, 4, ... workers, up to the number of CPUs, rwsd is started
+# with 'workers: N' and CLIENTS copies of bench_pipeline each fetch a
+# small file REQUESTS times over their own keep-alive connection, all
+# at once. This prints the total number of requests per second. The
+# clients run on the same machine, so leave some CPUs for them, or set
+# WORKERS to a shorter list.
+
+# A random, hopefully free, port.
+port=14139
+
+cpus=`getconf _NPROCESSORS_ONLN 2>/dev/null || echo 1`
+if [ -z "$WORKERS" ]; then
+	WORKERS=1
+	n=2
+	while [ $n -le $cpus ]; do
+		WORKERS="$WORKERS $n"
+		n=$(($n * 2))
+	done
+fi
+
+rwsd=${RWSD:-./rwsd}
+requests=${REQUESTS:-10000}
+clients=${CLIENTS:-$((4 * $cpus))}
+
+tmp=/tmp/rws-bench.$$
+rm -rf $tmp
+mkdir -p $tmp/etc/rws/hosts $tmp/log $tmp/html
+
+cat > $tmp/etc/rws/hosts/default <<EOF
+alias /
+	path:	$tmp/html
+end alias
+EOF
+(cd $tmp/etc/rws/hosts; ln -s default localhost:$port)
+
+cat > $tmp/etc/mime.types <<EOF
+text/html html
+EOF
+
+echo "<html><body>Small file.</body></html>" > $tmp/html/small.html
+
+echo "$cpus CPUs, $clients clients, $requests requests per client."
+
+status=0
+for w in $WORKERS; do
+	cat > $tmp/etc/rws/rws.conf <<EOF
+mime types file: $tmp/etc/mime.types
+error log: $tmp/log/error_log
+access log: /dev/null
+workers: $w
+EOF
+
+	$rwsd -p $port -f -a 127.0.0.1 -C $tmp/etc/rws &
+	rws_pid=$!; sleep 1
+
+	if kill -0 $rws_pid; then :;
+	else
+		echo "Server did not start up. Check any preceeding messages."
+		rm -rf $tmp
+		exit 1
+	fi
+
+	start=`date +%s.%N`
+	pids=
+	i=0
+	while [ $i -lt $clients ]; do
+		./bench_pipeline $port /small.html 1 $requests >/dev/null &
+		pids="$pids $!"
+		i=$(($i + 1))
+	done
+	for pid in $pids; do
+		wait $pid || status=1
+	done
+	end=`date +%s.%N`
+
+	kill $rws_pid; wait $rws_pid 2>/dev/null
+	if [ $status -ne 0 ]; then break; fi
+
+	echo $start $end | awk -v w=$w -v n=$(($clients * $requests)) \
+	  '{ printf "%2d workers: %8.0f requests/second\n", w, n / ($2 - $1) }'
+done
+
+# Remove the temporary directory.
+rm -rf $tmp
+
+exit $status
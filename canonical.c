@@ -0,0 +1,113 @@
+/* Path canonicalization.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#include "config.h"
+
+#include "canonical.h"
+
+static inline int
+hex_value (int c)
+{
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+/* Read the next character from *RP, decoding it if required, and
+ * advance *RP. An encoded NUL ends the string, as it always has.
+ */
+static inline int
+get_char (const char **rp, int unescape)
+{
+  const char *r = *rp;
+  int c = (unsigned char) *r, h, l;
+
+  if (c == '\0') return 0;
+
+  if (unescape)
+    {
+      if (c == '+')
+	c = ' ';
+      else if (c == '%' &&
+	       (h = hex_value (r[1])) >= 0 && (l = hex_value (r[2])) >= 0)
+	{
+	  *rp = r + 3;
+	  return h * 16 + l;
+	}
+    }
+
+  *rp = r + 1;
+  return c;
+}
+
+int
+canonicalize_path (char *path, int unescape, int *comps, int max_comps)
+{
+  const char *r = path;
+  char *w = path, *start, *comp;
+  int c, n = 0, is_dir = 0;
+
+  /* The output can never be longer than the input read so far, so it
+   * is safe to write it over the top.
+   */
+  c = get_char (&r, unescape);
+  for (;;)
+    {
+      /* Skip the '/' characters before the next component. */
+      is_dir = 0;
+      while (c == '/')
+	{
+	  is_dir = 1;
+	  c = get_char (&r, unescape);
+	}
+      if (c == 0) break;
+
+      /* Copy the component. */
+      start = w;
+      *w++ = '/';
+      comp = w;
+      do
+	{
+	  *w++ = c;
+	  c = get_char (&r, unescape);
+	}
+      while (c != '/' && c != 0);
+
+      if (w - comp == 1 && comp[0] == '.')
+	w = start;
+      else if (w - comp == 2 && comp[0] == '.' && comp[1] == '.')
+	{
+	  /* Drop this and the previous component, if any. */
+	  w = n > 0 ? path + comps[--n] - 1 : start;
+	}
+      else
+	{
+	  if (n >= max_comps) return -1;
+	  comps[n++] = comp - path;
+	}
+    }
+
+  if (w == path || (n > 0 && is_dir))
+    *w++ = '/';
+  *w = '\0';
+
+  return n;
+}
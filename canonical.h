@@ -0,0 +1,42 @@
+/* Path canonicalization.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#ifndef CANONICAL_H
+#define CANONICAL_H
+
+#include "config.h"
+
+/* Requests for paths with more components than this are refused. */
+#define MAX_PATH_COMPS 128
+
+/* Canonicalize PATH, which must begin with '/', in place: decode %
+ * sequences and '+' (if UNESCAPE is set), collapse repeated '/'
+ * characters and remove "." and ".." components. The result begins
+ * with '/', and ends with '/' only if the original did (or if it is
+ * just "/").
+ *
+ * The offset in PATH of the first character of each component is
+ * stored in COMPS. Returns the number of components, or -1 if there
+ * are more than MAX_COMPS.
+ */
+extern int canonicalize_path (char *path, int unescape,
+			      int *comps, int max_comps);
+
+#endif /* CANONICAL_H */
@@ -27,6 +27,26 @@
 #include <sys/types.h>
 #endif
 
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+
 #ifdef HAVE_DIRENT_H
 #include <dirent.h>
 #endif
@@ -47,66 +67,278 @@
 
 #include "re.h"
 #include "cfg.h"
+#include "route.h"
+#include "rewrite.h"
+#include "timecache.h"
+
+/* Each time the configuration files are read, the result is a new
+ * generation. Requests pin the current generation while they run (see
+ * cfg_pin), so a generation which has been replaced is only freed when
+ * nothing is using it, or any older generation, any more.
+ */
+struct generation
+{
+  pool pool;			/* Everything below is allocated here. */
+  int refs;			/* Number of pins. */
+  shash hosts;			/* Hash of string -> struct config_data * */
+  struct config_data *main;	/* The main configuration file. */
+  shash strings;		/* Interned strings (see intern). */
+  struct generation *next;	/* Next newer generation. */
+
+  /* With 'lazy hosts', HOSTS is empty and host files are only read
+   * when a request for the host arrives. At most MAX_LAZY_HOSTS of them
+   * are kept, in a list with the most recently used first.
+   */
+  int lazy;
+  shash lazy_hosts;		/* Hash of string -> struct lazy_host * */
+  struct lazy_host *lru_head, *lru_tail;
+  int nr_lazy_hosts, max_lazy_hosts;
+};
+
+/* The mtime, size and inode of a file, to tell if it has changed. */
+struct stamp
+{
+  long long mtime, size, ino;
+};
+
+/* A host file in 'lazy hosts' mode. */
+struct lazy_host
+{
+  const char *name;
+  const char *filename;
+  struct config_data *c;	/* The host, if it has been read. */
+  struct stamp stamp;		/* The file when it was read. */
+  time_t checked;		/* When STAMP was last checked. */
+  struct lazy_host *lru_prev, *lru_next;
+};
 
 struct config_data
 {
+  struct generation *gen;	/* Generation this belongs to. */
+  pool pool;			/* Where this is allocated. */
+
+  /* A lazily read host has its own pool, which is freed when the host
+   * has been retired (evicted, or found to be out of date) and there
+   * are no requests using it.
+   */
+  int lazy;
+  int refs;			/* Number of requests using it. */
+  int retired;
+
   sash data;
+  struct cfg_settings settings;
+
+  /* The value of each interned key (see cfg_intern), including values
+   * inherited from the main configuration. Keys numbered NR_VALUES or
+   * more are not in any configuration file read before this one.
+   */
+  const char **values;
+  int nr_values;
 
   /* Aliases -- these are only present in the host-specific configuration
    * files, not in CFG_MAIN.
    */
   shash aliases;		/* Hash of string -> struct alias_data * */
+
+  /* The same aliases, as a tree of path components, for finding the
+   * longest alias matching a path.
+   */
+  struct alias_node *alias_tree;
 };
 
 struct alias_data
 {
   sash data;
+  struct cfg_settings settings;
+
+  /* As above, including values inherited from the host. */
+  const char **values;
+  int nr_values;
+};
+
+struct alias_node
+{
+  /* If there is an alias for the path leading to this node, then this
+   * is its data, its name and its "path" setting.
+   */
+  struct alias_data *alias;
+  const char *aliasname;
+  const char *root;
+
+  vector children;		/* Vector of struct alias_child. */
 };
 
-static pool cfg_pool = 0;
-static shash cfg_hosts;		/* Hash of string -> struct config_data * */
-static struct config_data *cfg_main;
+struct alias_child
+{
+  const char *name;		/* Path component. */
+  int len;			/* strlen (name). */
+  struct alias_node *node;
+};
 
-static struct config_data *read_config (FILE *fp, int is_main, const char *filename);
+static struct generation *current = 0; /* The generation in service. */
+static struct generation *oldest = 0; /* List of generations not freed. */
+
+/* Interned keys. These are shared by all generations. */
+static shash keys = 0;		/* Hash of string -> cfg_key_t */
+static int nr_keys = 0;
+
+static int get_stamp (const char *filename, struct stamp *stamp);
+static struct config_data *new_config_data (struct generation *g, pool pool, int is_main);
+static struct config_data *read_config (struct generation *g, pool pool, FILE *fp, int is_main, const char *filename);
+static struct config_data *load_lazy_host (struct lazy_host *lh);
+static void retire_lazy_host (struct generation *g, struct lazy_host *lh);
+static void put_host (void *host_ptr);
+static int read_text (struct generation *g, const char *path);
+static int load_image (struct generation *g, const char *path);
+static struct generation *new_generation (void);
 static void config_err (const char *filename, const char *line, const char *msg);
+static struct alias_node *new_alias_node (pool pool);
+static void build_alias_tree (struct config_data *c);
+static void free_old_generations (void);
+static void compile_host (struct config_data *c);
+static void compile_values (pool values_pool, sash data,
+			    const char **parent, int nr_parent,
+			    const char ***values, int *nr_values);
+static const char *lookup (void *host_ptr, void *alias_ptr, cfg_key_t key);
+static int parse_int (const char *value, int default_value);
+static int parse_bool (const char *value, int default_value);
+static void compile_settings (struct cfg_settings *settings,
+			      struct config_data *c, struct alias_data *a);
+
+static int
+get_stamp (const char *filename, struct stamp *stamp)
+{
+  struct stat statbuf;
+
+  if (stat (filename, &statbuf) == -1)
+    return -1;
+  stamp->mtime = statbuf.st_mtime;
+  stamp->size = statbuf.st_size;
+  stamp->ino = statbuf.st_ino;
+  return 0;
+}
 
 /* The PATH argument will point to the base for configuration
  * files, eg. "/etc/rws". We append "/rws.conf" to get the main
  * configuration file and "/hosts/" to get the virtual hosts
  * directory.
  */
-void
-cfg_reread_config (const char *path)
+void *
+cfg_read_config (const char *path)
 {
-  const char *config_file;
-  const char *hosts_dir;
-  FILE *fp;
-  DIR *dir;
-  struct dirent *d;
-  pool tmp;
+  struct generation *g;
 
   /* Show the message about reloading the configuration file, but only
    * the second and subsequent times this function is run.
    */
-  if (cfg_pool)
+  if (current)
     fprintf (stderr, "reloading configuration file ...\n");
 
-  /* Remove any configuration data from previous configuration run. */
-  if (cfg_pool) delete_pool (cfg_pool);
+  /* Use the compiled image if there is an up to date one, else read
+   * the text files. The generation in service is left alone until the
+   * caller publishes this one.
+   */
+  g = new_generation ();
+  if (load_image (g, path) == 0)
+    return g;
+  delete_pool (g->pool);
+
+  g = new_generation ();
+  if (read_text (g, path) == 0)
+    return g;
+  delete_pool (g->pool);
+
+  return 0;
+}
+
+static struct generation *
+new_generation ()
+{
+  pool pool = new_subpool (global_pool);
+  struct generation *g;
+
+  g = pmalloc (pool, sizeof *g);
+  g->pool = pool;
+  g->refs = 0;
+  g->hosts = new_shash (pool, struct config_data *);
+  g->main = 0;
+  g->strings = new_shash (pool, const char *);
+  g->next = 0;
+  g->lazy = 0;
+  g->lazy_hosts = 0;
+  g->lru_head = g->lru_tail = 0;
+  g->nr_lazy_hosts = 0;
+  return g;
+}
+
+static struct config_data *
+new_config_data (struct generation *g, pool pool, int is_main)
+{
+  struct config_data *c;
 
-  /* Create new data structures. */
-  cfg_pool = new_subpool (global_pool);
-  tmp = new_subpool (cfg_pool);
-  cfg_hosts = new_shash (cfg_pool, struct config_data *);
+  c = pmalloc (pool, sizeof *c);
+  c->gen = g;
+  c->pool = pool;
+  c->lazy = pool != g->pool;
+  c->refs = 0;
+  c->retired = 0;
+  c->data = new_sash (pool);
+  if (!is_main) c->aliases = new_shash (pool, struct alias_data *);
+  else c->aliases = 0;
+  return c;
+}
+
+/* Read the text configuration files into G. */
+static int
+read_text (struct generation *g, const char *path)
+{
+  const char *config_file;
+  const char *hosts_dir;
+  FILE *fp;
+  DIR *dir;
+  struct dirent *d;
+  pool tmp = new_subpool (g->pool);
 
   config_file = psprintf (tmp, "%s/rws.conf", path);
   hosts_dir = psprintf (tmp, "%s/hosts/", path);
 
   /* Read in main configuration file. */
   fp = fopen (config_file, "r");
-  if (fp == 0) { perror (config_file); exit (1); }
-  cfg_main = read_config (fp, 1, config_file);
+  if (fp == 0) { perror (config_file); goto error; }
+  g->main = read_config (g, g->pool, fp, 1, config_file);
   fclose (fp);
+  if (!g->main) goto error;
+  compile_host (g->main);
+
+  /* In 'lazy hosts' mode, just note the names of the host files. */
+  if (cfg_get_bool (g->main, 0, "lazy hosts", 0))
+    {
+      g->lazy = 1;
+      g->lazy_hosts = new_shash (g->pool, struct lazy_host *);
+      g->max_lazy_hosts = cfg_get_int (g->main, 0, "lazy hosts cache", 1000);
+      if (g->max_lazy_hosts < 1) g->max_lazy_hosts = 1;
+
+      dir = opendir (hosts_dir);
+      if (dir)
+	{
+	  while ((d = readdir (dir)) != 0)
+	    if (d->d_name[0] != '.')
+	      {
+		struct lazy_host *lh = pmalloc (g->pool, sizeof *lh);
+
+		lh->name = pstrdup (g->pool, d->d_name);
+		lh->filename = psprintf (g->pool, "%s%s", hosts_dir, d->d_name);
+		lh->c = 0;
+		lh->checked = 0;
+		lh->lru_prev = lh->lru_next = 0;
+		shash_insert (g->lazy_hosts, d->d_name, lh);
+	      }
+	  closedir (dir);
+	}
+
+      delete_pool (tmp);
+      return 0;
+    }
 
   /* Read in each virtual host configuration file. */
   dir = opendir (hosts_dir);
@@ -123,11 +355,13 @@ cfg_reread_config (const char *path)
 	      p = psprintf (tmp, "%s/%s", hosts_dir, d->d_name);
 
 	      fp = fopen (p, "r");
-	      if (fp == 0) { perror (p); exit (1); }
-	      c = read_config (fp, 0, p);
+	      if (fp == 0) { perror (p); closedir (dir); goto error; }
+	      c = read_config (g, g->pool, fp, 0, p);
 	      fclose (fp);
+	      if (!c) { closedir (dir); goto error; }
+	      compile_host (c);
 
-	      shash_insert (cfg_hosts, d->d_name, c);
+	      shash_insert (g->hosts, d->d_name, c);
 	    }
 	}
 
@@ -135,21 +369,106 @@ cfg_reread_config (const char *path)
     }
 
   delete_pool (tmp);
+  return 0;
+
+ error:
+  delete_pool (tmp);
+  return -1;
+}
+
+pool
+cfg_get_pool (void *gen)
+{
+  return ((struct generation *) gen)->pool;
+}
+
+void *
+cfg_get_main (void *gen)
+{
+  return ((struct generation *) gen)->main;
+}
+
+vector
+cfg_get_hosts (void *gen)
+{
+  return shash_values (((struct generation *) gen)->hosts);
+}
+
+void
+cfg_publish (void *gen)
+{
+  struct generation *g = (struct generation *) gen, *last;
+
+  if (oldest)
+    {
+      for (last = oldest; last->next; last = last->next)
+	;
+      last->next = g;
+    }
+  else
+    oldest = g;
+
+  current = g;
+  free_old_generations ();
+
+  /* Throw away routes which were resolved with the old configuration. */
+  route_flush ();
+}
+
+void
+cfg_discard (void *gen)
+{
+  delete_pool (((struct generation *) gen)->pool);
+}
+
+void *
+cfg_pin ()
+{
+  current->refs++;
+  return current;
+}
+
+void
+cfg_unpin (void *gen)
+{
+  ((struct generation *) gen)->refs--;
+  free_old_generations ();
+}
+
+/* Free generations from the oldest, until we reach one which is still
+ * in use. A request only pins the generation which was current when it
+ * started, but it may also have been given things from newer ones (eg.
+ * by mime_types_get_type), so those are kept too.
+ */
+static void
+free_old_generations ()
+{
+  struct generation *g;
+
+  while (oldest != current && oldest->refs == 0)
+    {
+      g = oldest;
+      oldest = g->next;
+
+      /* Lazily read hosts aren't in the generation's pool. */
+      while (g->lru_head)
+	retire_lazy_host (g, g->lru_head);
+
+      delete_pool (g->pool);
+    }
 }
 
 /* Read in a config file from FP. */
 static struct config_data *
-read_config (FILE *fp, int is_main, const char *filename)
+read_config (struct generation *g, pool data_pool, FILE *fp, int is_main,
+	     const char *filename)
 {
-  pool tmp = new_subpool (cfg_pool);
+  pool tmp = new_subpool (data_pool);
   char *line = 0;
   struct config_data *c;
   struct alias_data *a = 0;
 
-  c = pmalloc (cfg_pool, sizeof *c);
-  c->data = new_sash (cfg_pool);
-  if (!is_main) c->aliases = new_shash (cfg_pool, struct alias_data *);
-  else c->aliases = 0;
+  c = new_config_data (g, data_pool, is_main);
 
   while ((line = pgetlinec (tmp, fp, line)))
     {
@@ -159,21 +478,31 @@ read_config (FILE *fp, int is_main, const char *filename)
 	{
 	  const char *aliasname;
 
-	  if (a) config_err (filename, line, "nested alias");
+	  if (a)
+	    {
+	      config_err (filename, line, "nested alias");
+	      goto error;
+	    }
 
 	  vector_get (v, 1, aliasname);
 
-	  a = pmalloc (cfg_pool, sizeof *a);
-	  a->data = new_sash (cfg_pool);
+	  a = pmalloc (data_pool, sizeof *a);
+	  a->data = new_sash (data_pool);
 
 	  if (shash_insert (c->aliases, aliasname, a))
-	    config_err (filename, line, "duplicate alias");
+	    {
+	      config_err (filename, line, "duplicate alias");
+	      goto error;
+	    }
 	}
       else if (!is_main && prematch (tmp, line, re_alias_end, 0))
 	{
 	  if (!a)
-	    config_err (filename, line,
-		       "end alias found, but not inside an alias definition");
+	    {
+	      config_err (filename, line,
+			  "end alias found, but not inside an alias definition");
+	      goto error;
+	    }
 
 	  a = 0;
 	}
@@ -198,13 +527,19 @@ read_config (FILE *fp, int is_main, const char *filename)
 	    }
 
 	  if (!line)
-	    config_err (filename, "EOF", "missing end <key> line");
+	    {
+	      config_err (filename, "EOF", "missing end <key> line");
+	      goto error;
+	    }
 
 	  if (a) s = a->data;
 	  else s = c->data;
 
 	  if (sash_insert (s, key, value))
-	    config_err (filename, line, "duplicate definition");
+	    {
+	      config_err (filename, line, "duplicate definition");
+	      goto error;
+	    }
 	}
       else if ((v = prematch (tmp, line, re_conf_line, 0)))
 	{
@@ -223,15 +558,263 @@ read_config (FILE *fp, int is_main, const char *filename)
 	  else s = c->data;
 
 	  if (sash_insert (s, key, value))
-	    config_err (filename, line, "duplicate definition");
+	    {
+	      config_err (filename, line, "duplicate definition");
+	      goto error;
+	    }
 	}
       else
-	config_err (filename, line, "unexpected line");
+	{
+	  config_err (filename, line, "unexpected line");
+	  goto error;
+	}
     }
 
   delete_pool (tmp);
-
   return c;
+
+ error:
+  delete_pool (tmp);
+  return 0;
+}
+
+static struct alias_node *
+new_alias_node (pool pool)
+{
+  struct alias_node *node = pmalloc (pool, sizeof *node);
+
+  node->alias = 0;
+  node->aliasname = 0;
+  node->root = 0;
+  node->children = new_vector (pool, struct alias_child);
+  return node;
+}
+
+/* Add all the aliases of host C to its alias tree. */
+static void
+build_alias_tree (struct config_data *c)
+{
+  pool pool = c->pool, tmp = new_subpool (pool);
+  vector names, comps;
+  const char *aliasname, *comp;
+  struct alias_data *a;
+  struct alias_node *node;
+  struct alias_child *child;
+  int i, j, k, len;
+
+  c->alias_tree = new_alias_node (pool);
+
+  names = shash_keys (c->aliases);
+  for (i = 0; i < vector_size (names); ++i)
+    {
+      vector_get (names, i, aliasname);
+      shash_get (c->aliases, aliasname, a);
+
+      /* Only names of the form "/" or "/a/b/" can ever match a
+       * request. Others stay reachable through cfg_get_alias.
+       */
+      len = strlen (aliasname);
+      if (len == 0 || aliasname[0] != '/' || aliasname[len-1] != '/' ||
+	  strstr (aliasname, "//") != 0)
+	continue;
+
+      /* The split has empty fields before the first "/" and after the
+       * last one, which are skipped.
+       */
+      comps = pstrcsplit (tmp, aliasname, '/');
+
+      node = c->alias_tree;
+      for (j = 0; j < vector_size (comps); ++j)
+	{
+	  vector_get (comps, j, comp);
+	  if (strcmp (comp, "") == 0)
+	    continue;
+	  if (strcmp (comp, ".") == 0 || strcmp (comp, "..") == 0)
+	    goto next_alias;
+
+	  for (k = 0; k < vector_size (node->children); ++k)
+	    {
+	      vector_get_ptr (node->children, k, child);
+	      if (strcmp (child->name, comp) == 0)
+		{
+		  node = child->node;
+		  goto next_comp;
+		}
+	    }
+
+	  {
+	    struct alias_child new_child;
+
+	    new_child.name = pstrdup (pool, comp);
+	    new_child.len = strlen (comp);
+	    new_child.node = new_alias_node (pool);
+	    vector_push_back (node->children, new_child);
+	    node = new_child.node;
+	  }
+	next_comp:;
+	}
+
+      node->alias = a;
+      node->aliasname = pstrdup (pool, aliasname);
+      node->root = cfg_get_string (c, a, "path", 0);
+    next_alias:;
+    }
+
+  delete_pool (tmp);
+}
+
+/* Work out the values and settings of host C (or the main
+ * configuration) and of each of its aliases, and build its alias tree.
+ */
+static void
+compile_host (struct config_data *c)
+{
+  struct config_data *main = c->gen->main;
+  vector names = 0;
+  const char *aliasname;
+  struct alias_data *a;
+  int i;
+
+  /* Each scope inherits the values of the one above it, so looking up
+   * a key never has to fall back to another scope.
+   */
+  if (main && main != c)
+    compile_values (c->pool, c->data, main->values, main->nr_values,
+		    &c->values, &c->nr_values);
+  else
+    compile_values (c->pool, c->data, 0, 0, &c->values, &c->nr_values);
+
+  if (c->aliases)
+    {
+      names = shash_keys_in_pool (c->aliases, c->pool);
+      for (i = 0; i < vector_size (names); ++i)
+	{
+	  vector_get (names, i, aliasname);
+	  shash_get (c->aliases, aliasname, a);
+	  compile_values (c->pool, a->data, c->values, c->nr_values,
+			  &a->values, &a->nr_values);
+	}
+    }
+
+  compile_settings (&c->settings, c, 0);
+
+  if (!names) return;
+
+  build_alias_tree (c);
+
+  for (i = 0; i < vector_size (names); ++i)
+    {
+      vector_get (names, i, aliasname);
+      shash_get (c->aliases, aliasname, a);
+      compile_settings (&a->settings, c, a);
+    }
+}
+
+/* Make the array of values of a scope, from its key/value pairs DATA
+ * and the values of the scope above it, PARENT.
+ */
+static void
+compile_values (pool values_pool, sash data,
+		const char **parent, int nr_parent,
+		const char ***values, int *nr_values)
+{
+  pool tmp = new_subpool (values_pool);
+  vector names = sash_keys_in_pool (data, tmp);
+  const char *name, *value;
+  const char **v;
+  int i;
+
+  /* Intern the keys first, so we know how large the array must be. */
+  for (i = 0; i < vector_size (names); ++i)
+    {
+      vector_get (names, i, name);
+      cfg_intern (name);
+    }
+
+  v = pcalloc (values_pool, nr_keys, sizeof *v);
+  if (nr_parent > 0) memcpy (v, parent, nr_parent * sizeof *v);
+
+  for (i = 0; i < vector_size (names); ++i)
+    {
+      vector_get (names, i, name);
+      sash_get (data, name, value);
+      v[cfg_intern (name)] = value;
+    }
+
+  delete_pool (tmp);
+  *values = v;
+  *nr_values = nr_keys;
+}
+
+static const char *
+intern (struct config_data *c, const char *str)
+{
+  struct generation *g = c->gen;
+  const char *r;
+
+  if (!str) return 0;
+
+  /* A lazily read host may be freed before the generation, so it
+   * keeps its own copy.
+   */
+  if (c->lazy) return pstrdup (c->pool, str);
+
+  if (!shash_get (g->strings, str, r))
+    {
+      r = pstrdup (g->pool, str);
+      shash_insert (g->strings, r, r);
+    }
+  return r;
+}
+
+static void
+compile_settings (struct cfg_settings *settings,
+		  struct config_data *c, struct alias_data *a)
+{
+  const char *expires;
+  char pm, unit;
+  int length;
+
+  memset (settings, 0, sizeof *settings);
+
+  if (cfg_get_bool (c, a, "exec so", 0)) settings->flags |= CFG_EXEC_SO;
+  if (cfg_get_bool (c, a, "exec", 0)) settings->flags |= CFG_EXEC;
+  if (cfg_get_bool (c, a, "show", 0)) settings->flags |= CFG_SHOW;
+  if (cfg_get_bool (c, a, "list", 0)) settings->flags |= CFG_LIST;
+
+  /* The expiry time has the form '[+|-]NN[s|m|h|d|y]'. */
+  expires = cfg_get_string (c, a, "expires", 0);
+  if (expires)
+    {
+      if (sscanf (expires, "%c%d%c", &pm, &length, &unit) == 3 &&
+	  (pm == '+' || pm == '-') &&
+	  length > 0 &&
+	  (unit == 's' || unit == 'm' || unit == 'h' ||
+	   unit == 'd' || unit == 'y'))
+	{
+	  settings->expires_ok = 1;
+	  settings->expires_delta = length;
+	  switch (unit)
+	    {
+	    case 'm': settings->expires_delta *= 60; break;
+	    case 'h': settings->expires_delta *= 60 * 60; break;
+	    case 'd': settings->expires_delta *= 60 * 60 * 24; break;
+	    case 'y': settings->expires_delta *= 60 * 60 * 24 * 366; break;
+	    }
+	  if (pm == '-') settings->expires_delta = -settings->expires_delta;
+	}
+      else
+	fprintf (stderr, "rws: cannot parse expires setting '%s'\n", expires);
+    }
+
+  settings->maintainer =
+    intern (c, cfg_get_string (c, a, "maintainer", "(no maintainer)"));
+
+  settings->compress_types =
+    intern (c, cfg_get_string (c, a, "compress types", 0));
+  settings->compress_min_size = cfg_get_int (c, a, "compress min size", 256);
+  settings->compress_max_size =
+    cfg_get_int (c, a, "compress max size", 1024 * 1024);
 }
 
 static void
@@ -242,18 +825,144 @@ config_err (const char *filename, const char *line, const char *msg)
 	   "rws: near ``%s''\n",
 	   filename, msg,
 	   line);
-  exit (1);
 }
 
 void *
-cfg_get_host (const char *host)
+cfg_get_host (pool pool, const char *host)
 {
+  struct generation *g = current;
   struct config_data *c = 0;
+  struct lazy_host *lh;
+  struct stamp stamp;
+  time_t now;
+
+  if (!g->lazy)
+    {
+      shash_get (g->hosts, host, c);
+      return c;
+    }
 
-  shash_get (cfg_hosts, host, c);
+  if (!shash_get (g->lazy_hosts, host, lh))
+    return 0;
+
+  /* If we have the host already, check (at most once a second) that
+   * the file hasn't changed.
+   */
+  if (lh->c)
+    {
+      now = timecache_now ();
+      if (lh->checked != now)
+	{
+	  lh->checked = now;
+	  if (get_stamp (lh->filename, &stamp) == -1 ||
+	      memcmp (&stamp, &lh->stamp, sizeof stamp) != 0)
+	    retire_lazy_host (g, lh);
+	}
+    }
+
+  if (lh->c)
+    {
+      /* Move it to the front of the list. */
+      if (lh != g->lru_head)
+	{
+	  lh->lru_prev->lru_next = lh->lru_next;
+	  if (lh->lru_next) lh->lru_next->lru_prev = lh->lru_prev;
+	  else g->lru_tail = lh->lru_prev;
+	  lh->lru_prev = 0;
+	  lh->lru_next = g->lru_head;
+	  g->lru_head->lru_prev = lh;
+	  g->lru_head = lh;
+	}
+    }
+  else
+    {
+      if (load_lazy_host (lh) == 0)
+	return 0;
+
+      lh->lru_prev = 0;
+      lh->lru_next = g->lru_head;
+      if (g->lru_head) g->lru_head->lru_prev = lh;
+      else g->lru_tail = lh;
+      g->lru_head = lh;
+      g->nr_lazy_hosts++;
+
+      while (g->nr_lazy_hosts > g->max_lazy_hosts)
+	retire_lazy_host (g, g->lru_tail);
+    }
+
+  c = lh->c;
+  c->refs++;
+  pool_register_cleanup_fn (pool, put_host, c);
   return c;
 }
 
+/* Read the file of a lazily loaded host. Returns NULL if there is an
+ * error, in which case the host is treated as unknown (until the file
+ * is fixed).
+ */
+static struct config_data *
+load_lazy_host (struct lazy_host *lh)
+{
+  struct generation *g = current;
+  pool pool;
+  FILE *fp;
+
+  if (get_stamp (lh->filename, &lh->stamp) == -1 ||
+      (fp = fopen (lh->filename, "r")) == 0)
+    {
+      perror (lh->filename);
+      return 0;
+    }
+
+  pool = new_subpool (global_pool);
+  lh->c = read_config (g, pool, fp, 0, lh->filename);
+  fclose (fp);
+  if (lh->c == 0)
+    {
+      delete_pool (pool);
+      return 0;
+    }
+  compile_host (lh->c);
+  lh->checked = timecache_now ();
+
+  return lh->c;
+}
+
+/* Forget the host LH has read. It is freed when no requests are using
+ * it.
+ */
+static void
+retire_lazy_host (struct generation *g, struct lazy_host *lh)
+{
+  struct config_data *c = lh->c;
+
+  if (lh->lru_prev) lh->lru_prev->lru_next = lh->lru_next;
+  else g->lru_head = lh->lru_next;
+  if (lh->lru_next) lh->lru_next->lru_prev = lh->lru_prev;
+  else g->lru_tail = lh->lru_prev;
+  lh->lru_prev = lh->lru_next = 0;
+  g->nr_lazy_hosts--;
+  lh->c = 0;
+
+  /* Cached results which refer to it are now wrong. */
+  route_forget_host (c);
+  rewrite_forget_host (lh->name);
+
+  c->retired = 1;
+  if (c->refs == 0)
+    delete_pool (c->pool);
+}
+
+static void
+put_host (void *host_ptr)
+{
+  struct config_data *c = (struct config_data *) host_ptr;
+
+  c->refs--;
+  if (c->retired && c->refs == 0)
+    delete_pool (c->pool);
+}
+
 void *
 cfg_get_alias (void *host_ptr, const char *path)
 {
@@ -264,28 +973,138 @@ cfg_get_alias (void *host_ptr, const char *path)
   return a;
 }
 
-const char *
-cfg_get_string (void *host_ptr, void *alias_ptr,
-		const char *key, const char *default_value)
+void *
+cfg_find_alias (void *host_ptr, const char *path,
+		const int *comps, int nr_comps, int *nr_matched,
+		const char **aliasname, const char **root)
+{
+  struct config_data *c = (struct config_data *) host_ptr;
+  const struct alias_node *node = c->alias_tree, *best = 0;
+  const struct alias_child *child;
+  int i, j, len, end;
+
+  len = strlen (path);
+  if (len > 1 && path[len-1] == '/') len--;
+
+  if (node->alias) { best = node; *nr_matched = 0; }
+
+  for (i = 0; i < nr_comps; ++i)
+    {
+      end = i < nr_comps-1 ? comps[i+1] - 1 : len;
+
+      for (j = 0; j < vector_size (node->children); ++j)
+	{
+	  vector_get_ptr (node->children, j, child);
+	  if (child->len == end - comps[i] &&
+	      memcmp (child->name, path + comps[i], child->len) == 0)
+	    goto found;
+	}
+      break;
+
+    found:
+      node = child->node;
+      if (node->alias) { best = node; *nr_matched = i+1; }
+    }
+
+  if (!best) return 0;
+
+  *aliasname = best->aliasname;
+  *root = best->root;
+  return best->alias;
+}
+
+const struct cfg_settings *
+cfg_get_settings (void *host_ptr, void *alias_ptr)
 {
   struct config_data *c = (struct config_data *) host_ptr;
   struct alias_data *a = (struct alias_data *) alias_ptr;
-  const char *value;
 
-  if (a && sash_get (a->data, key, value))
-    return value;
-  if (c && sash_get (c->data, key, value))
-    return value;
-  if (sash_get (cfg_main->data, key, value))
-    return value;
+  if (a) return &a->settings;
+  if (c) return &c->settings;
+  return &current->main->settings;
+}
+
+cfg_key_t
+cfg_intern (const char *key)
+{
+  cfg_key_t k;
+
+  if (!keys) keys = new_shash (global_pool, cfg_key_t);
+
+  if (!shash_get (keys, key, k))
+    {
+      k = nr_keys++;
+      shash_insert (keys, key, k);
+    }
+  return k;
+}
+
+static const char *
+lookup (void *host_ptr, void *alias_ptr, cfg_key_t key)
+{
+  struct config_data *c = (struct config_data *) host_ptr;
+  struct alias_data *a = (struct alias_data *) alias_ptr;
+
+  if (a)
+    return key < a->nr_values ? a->values[key] : 0;
+  if (!c) c = current->main;
+  return key < c->nr_values ? c->values[key] : 0;
+}
+
+const char *
+cfg_get_string_key (void *host_ptr, void *alias_ptr,
+		    cfg_key_t key, const char *default_value)
+{
+  const char *value = lookup (host_ptr, alias_ptr, key);
+
+  return value ? value : default_value;
+}
+
+int
+cfg_get_int_key (void *host_ptr, void *alias_ptr,
+		 cfg_key_t key, int default_value)
+{
+  return parse_int (lookup (host_ptr, alias_ptr, key), default_value);
+}
+
+int
+cfg_get_bool_key (void *host_ptr, void *alias_ptr,
+		  cfg_key_t key, int default_value)
+{
+  return parse_bool (lookup (host_ptr, alias_ptr, key), default_value);
+}
+
+/* The string versions look the key up without interning it, so that
+ * callers (such as .so modules) can't fill the table with keys which
+ * no configuration file uses.
+ */
+const char *
+cfg_get_string (void *host_ptr, void *alias_ptr,
+		const char *key, const char *default_value)
+{
+  cfg_key_t k;
 
-  return default_value;
+  if (!keys || !shash_get (keys, key, k)) return default_value;
+  return cfg_get_string_key (host_ptr, alias_ptr, k, default_value);
 }
 
 int
 cfg_get_int (void *host_ptr, void *alias_ptr, const char *key, int default_value)
 {
-  const char *value = cfg_get_string (host_ptr, alias_ptr, key, 0);
+  return parse_int (cfg_get_string (host_ptr, alias_ptr, key, 0),
+		    default_value);
+}
+
+int
+cfg_get_bool (void *host_ptr, void *alias_ptr, const char *key, int default_value)
+{
+  return parse_bool (cfg_get_string (host_ptr, alias_ptr, key, 0),
+		     default_value);
+}
+
+static int
+parse_int (const char *value, int default_value)
+{
   int r;
 
   if (!value) return default_value;
@@ -295,11 +1114,9 @@ cfg_get_int (void *host_ptr, void *alias_ptr, const char *key, int default_value
   return r;
 }
 
-int
-cfg_get_bool (void *host_ptr, void *alias_ptr, const char *key, int default_value)
+static int
+parse_bool (const char *value, int default_value)
 {
-  const char *value = cfg_get_string (host_ptr, alias_ptr, key, 0);
-
   if (!value) return default_value;
 
   if (value[0] == '0' ||
@@ -317,3 +1134,359 @@ cfg_get_bool (void *host_ptr, void *alias_ptr, const char *key, int default_valu
   else
     return default_value;
 }
+
+/* The compiled configuration image, written by 'rwsd --compile-config'
+ * to PATH/rws.image. It holds the key/value pairs of rws.conf and of
+ * each host file, so loading it needs no regular expressions. Numbers
+ * are in the native format, since the image is only meant to be used
+ * on the machine which made it:
+ *
+ *   "RWSCFG01", int version, long long hosts directory mtime,
+ *   int number of hosts,
+ *   main file: stamp, settings,
+ *   each host: string name, stamp, settings.
+ *
+ * A stamp is the mtime, size and inode of the text file (long long
+ * each). Settings are an int count of key/value pairs, the pairs, an
+ * int count of aliases, and for each alias its name, an int count of
+ * pairs and the pairs. Strings are an int length, the bytes and a
+ * '\0'. If any text file has changed since the image was made, the
+ * image is ignored.
+ */
+#define IMAGE_MAGIC "RWSCFG01"
+#define IMAGE_VERSION 1
+
+static void
+put_int (FILE *fp, int i)
+{
+  fwrite (&i, sizeof i, 1, fp);
+}
+
+static void
+put_string (FILE *fp, const char *str)
+{
+  int len = strlen (str);
+
+  put_int (fp, len);
+  fwrite (str, len + 1, 1, fp);
+}
+
+static void
+put_pairs (FILE *fp, pool tmp, sash data)
+{
+  vector keys;
+  const char *key, *value;
+  int i;
+
+  keys = sash_keys_in_pool (data, tmp);
+  put_int (fp, vector_size (keys));
+  for (i = 0; i < vector_size (keys); ++i)
+    {
+      vector_get (keys, i, key);
+      sash_get (data, key, value);
+      put_string (fp, key);
+      put_string (fp, value);
+    }
+}
+
+static void
+put_settings (FILE *fp, pool tmp, const struct config_data *c)
+{
+  vector names;
+  const char *aliasname;
+  struct alias_data *a;
+  int i;
+
+  put_pairs (fp, tmp, c->data);
+
+  if (!c->aliases)
+    {
+      put_int (fp, 0);
+      return;
+    }
+
+  names = shash_keys_in_pool (c->aliases, tmp);
+  put_int (fp, vector_size (names));
+  for (i = 0; i < vector_size (names); ++i)
+    {
+      vector_get (names, i, aliasname);
+      shash_get (c->aliases, aliasname, a);
+      put_string (fp, aliasname);
+      put_pairs (fp, tmp, a->data);
+    }
+}
+
+int
+cfg_compile_config (const char *path)
+{
+  pool tmp = new_subpool (global_pool);
+  struct generation *g;
+  struct stamp stamp, dir_stamp;
+  shash stamps;
+  vector names;
+  const char *config_file, *hosts_dir, *name, *image, *tmpname;
+  struct config_data *c;
+  DIR *dir;
+  struct dirent *d;
+  FILE *fp;
+  int i;
+
+  config_file = psprintf (tmp, "%s/rws.conf", path);
+  hosts_dir = psprintf (tmp, "%s/hosts", path);
+  image = psprintf (tmp, "%s/rws.image", path);
+  tmpname = psprintf (tmp, "%s.%d.tmp", image, (int) getpid ());
+
+  /* Note the state of the files before reading them, so that if one
+   * changes while we are working, the image will be seen to be out of
+   * date.
+   */
+  stamps = new_shash (tmp, struct stamp);
+  if (get_stamp (hosts_dir, &dir_stamp) == -1) dir_stamp.mtime = 0;
+  dir = opendir (hosts_dir);
+  if (dir)
+    {
+      while ((d = readdir (dir)) != 0)
+	if (d->d_name[0] != '.' &&
+	    get_stamp (psprintf (tmp, "%s/%s", hosts_dir, d->d_name),
+		       &stamp) == 0)
+	  shash_insert (stamps, d->d_name, stamp);
+      closedir (dir);
+    }
+  if (get_stamp (config_file, &stamp) == -1)
+    {
+      perror (config_file);
+      goto error;
+    }
+
+  g = new_generation ();
+  if (read_text (g, path) == -1)
+    {
+      delete_pool (g->pool);
+      goto error;
+    }
+
+  fp = fopen (tmpname, "w");
+  if (fp == 0)
+    {
+      perror (tmpname);
+      delete_pool (g->pool);
+      goto error;
+    }
+
+  names = shash_keys_in_pool (g->hosts, tmp);
+
+  fwrite (IMAGE_MAGIC, 8, 1, fp);
+  put_int (fp, IMAGE_VERSION);
+  fwrite (&dir_stamp.mtime, sizeof dir_stamp.mtime, 1, fp);
+  put_int (fp, vector_size (names));
+
+  fwrite (&stamp, sizeof stamp, 1, fp);
+  put_settings (fp, tmp, g->main);
+
+  for (i = 0; i < vector_size (names); ++i)
+    {
+      vector_get (names, i, name);
+      shash_get (g->hosts, name, c);
+      if (!shash_get (stamps, name, stamp))
+	{
+	  fprintf (stderr,
+		   "rws: %s/%s: appeared while compiling the configuration\n",
+		   hosts_dir, name);
+	  fclose (fp);
+	  unlink (tmpname);
+	  delete_pool (g->pool);
+	  goto error;
+	}
+      put_string (fp, name);
+      fwrite (&stamp, sizeof stamp, 1, fp);
+      put_settings (fp, tmp, c);
+    }
+
+  delete_pool (g->pool);
+
+  if (fclose (fp) == EOF || rename (tmpname, image) == -1)
+    {
+      perror (image);
+      unlink (tmpname);
+      goto error;
+    }
+
+  delete_pool (tmp);
+  return 0;
+
+ error:
+  delete_pool (tmp);
+  return -1;
+}
+
+/* Reading the image. These return -1 if the image is truncated. */
+struct image
+{
+  const char *p, *end;
+};
+
+static int
+get_bytes (struct image *im, void *buf, int n)
+{
+  if (im->end - im->p < n) return -1;
+  memcpy (buf, im->p, n);
+  im->p += n;
+  return 0;
+}
+
+static int
+get_int (struct image *im, int *i)
+{
+  return get_bytes (im, i, sizeof *i);
+}
+
+/* Strings are used where they are in the image (sash_insert copies
+ * them).
+ */
+static int
+get_string (struct image *im, const char **str)
+{
+  int len;
+
+  if (get_int (im, &len) == -1 || len < 0 || im->end - im->p < len + 1 ||
+      im->p[len] != '\0')
+    return -1;
+  *str = im->p;
+  im->p += len + 1;
+  return 0;
+}
+
+static int
+get_pairs (struct image *im, sash data)
+{
+  const char *key, *value;
+  int n;
+
+  if (get_int (im, &n) == -1) return -1;
+  while (n-- > 0)
+    {
+      if (get_string (im, &key) == -1 || get_string (im, &value) == -1)
+	return -1;
+      sash_insert (data, key, value);
+    }
+  return 0;
+}
+
+static struct config_data *
+get_settings (struct image *im, struct generation *g, int is_main)
+{
+  struct config_data *c = new_config_data (g, g->pool, is_main);
+  struct alias_data *a;
+  const char *aliasname;
+  int n;
+
+  if (get_pairs (im, c->data) == -1 || get_int (im, &n) == -1)
+    return 0;
+  if (is_main && n != 0)
+    return 0;
+  while (n-- > 0)
+    {
+      if (get_string (im, &aliasname) == -1)
+	return 0;
+      a = pmalloc (g->pool, sizeof *a);
+      a->data = new_sash (g->pool);
+      shash_insert (c->aliases, aliasname, a);
+      if (get_pairs (im, a->data) == -1)
+	return 0;
+    }
+
+  if (is_main) g->main = c;
+  compile_host (c);
+  return c;
+}
+
+/* Load PATH/rws.image into G. Returns -1 if there is no image, or it
+ * is out of date or damaged.
+ */
+static int
+load_image (struct generation *g, const char *path)
+{
+  pool tmp = new_subpool (g->pool);
+  const char *image, *name;
+  struct stamp stamp, file_stamp;
+  struct config_data *c;
+  struct image im;
+  struct stat statbuf;
+  void *addr = MAP_FAILED;
+  long long dir_mtime;
+  int fd, version, nr_hosts;
+  char magic[8];
+
+  image = psprintf (tmp, "%s/rws.image", path);
+  fd = open (image, O_RDONLY);
+  if (fd == -1)
+    {
+      delete_pool (tmp);
+      return -1;
+    }
+  if (fstat (fd, &statbuf) == -1 || statbuf.st_size == 0 ||
+      (addr = mmap (0, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0))
+      == MAP_FAILED)
+    goto bad;
+
+  im.p = addr;
+  im.end = im.p + statbuf.st_size;
+
+  if (get_bytes (&im, magic, 8) == -1 ||
+      memcmp (magic, IMAGE_MAGIC, 8) != 0 ||
+      get_int (&im, &version) == -1 || version != IMAGE_VERSION ||
+      get_bytes (&im, &dir_mtime, sizeof dir_mtime) == -1 ||
+      get_int (&im, &nr_hosts) == -1)
+    goto bad;
+
+  /* Hosts added or removed? */
+  if (get_stamp (psprintf (tmp, "%s/hosts", path), &file_stamp) == -1)
+    file_stamp.mtime = 0;
+  if (file_stamp.mtime != dir_mtime)
+    goto stale;
+
+  if (get_bytes (&im, &stamp, sizeof stamp) == -1)
+    goto bad;
+  if (get_stamp (psprintf (tmp, "%s/rws.conf", path), &file_stamp) == -1 ||
+      memcmp (&stamp, &file_stamp, sizeof stamp) != 0)
+    goto stale;
+  if ((g->main = get_settings (&im, g, 1)) == 0)
+    goto bad;
+
+  /* In 'lazy hosts' mode the host files are read as they are needed,
+   * so loading them all from the image would defeat the point.
+   */
+  if (cfg_get_bool (g->main, 0, "lazy hosts", 0))
+    goto fail;
+
+  while (nr_hosts-- > 0)
+    {
+      if (get_string (&im, &name) == -1 ||
+	  get_bytes (&im, &stamp, sizeof stamp) == -1)
+	goto bad;
+      if (get_stamp (psprintf (tmp, "%s/hosts/%s", path, name),
+		     &file_stamp) == -1 ||
+	  memcmp (&stamp, &file_stamp, sizeof stamp) != 0)
+	goto stale;
+      if ((c = get_settings (&im, g, 0)) == 0)
+	goto bad;
+      shash_insert (g->hosts, name, c);
+    }
+
+  munmap (addr, statbuf.st_size);
+  close (fd);
+  delete_pool (tmp);
+  return 0;
+
+ stale:
+  fprintf (stderr, "rws: %s is out of date, reading the text files\n",
+	   image);
+  goto fail;
+ bad:
+  fprintf (stderr, "rws: %s is damaged, reading the text files\n", image);
+ fail:
+  if (addr != MAP_FAILED) munmap (addr, statbuf.st_size);
+  close (fd);
+  delete_pool (tmp);
+  return -1;
+}
@@ -21,21 +21,103 @@
 #ifndef CFG_H
 #define CFG_H
 
+#include <pool.h>
+#include <vector.h>
 #include <hash.h>
 
-/* Reread the configuration file. */
-extern void cfg_reread_config (const char *path);
+/* Read the configuration files under PATH into a new generation,
+ * which is not used until it is published. Returns an opaque pointer
+ * to the generation, or NULL (after printing a message) if the files
+ * can't be read or contain errors.
+ */
+extern void *cfg_read_config (const char *path);
+
+/* Read the configuration files under PATH and write them to the
+ * compiled image PATH/rws.image, which CFG_READ_CONFIG loads instead of
+ * the text files for as long as none of them has changed. Returns 0,
+ * or -1 (after printing a message) if there is an error.
+ */
+extern int cfg_compile_config (const char *path);
+
+/* The pool of generation GEN. Anything allocated in it lasts as long
+ * as the generation.
+ */
+extern pool cfg_get_pool (void *gen);
+
+/* Return the main configuration of GEN, as a host pointer which may be
+ * passed to CFG_GET_STRING and friends.
+ */
+extern void *cfg_get_main (void *gen);
+
+/* Return a vector of the hosts of GEN (as host pointers). In 'lazy
+ * hosts' mode, this only has the hosts which have been read.
+ */
+extern vector cfg_get_hosts (void *gen);
+
+/* Make GEN the current configuration, or throw it away. The previous
+ * configuration is freed when no requests are using it.
+ */
+extern void cfg_publish (void *gen);
+extern void cfg_discard (void *gen);
+
+/* A request pins the current configuration while it runs, so that the
+ * host and alias pointers it holds stay valid. CFG_PIN returns the
+ * generation, which must be passed to CFG_UNPIN afterwards.
+ */
+extern void *cfg_pin (void);
+extern void cfg_unpin (void *gen);
 
 /* If there is host matching HOST, return an opaque pointer to the host's
- * configuration data.
+ * configuration data, which stays valid until POOL is deleted. In 'lazy
+ * hosts' mode, this reads the host file the first time, or when it has
+ * changed.
  */
-extern void *cfg_get_host (const char *host);
+extern void *cfg_get_host (pool pool, const char *host);
 
 /* If there is an alias exactly matching PATH for host HOST_PTR, return
  * an opaque pointer to the alias's configuration data.
  */
 extern void *cfg_get_alias (void *host_ptr, const char *path);
 
+/* Find the longest alias of host HOST_PTR which matches the start of
+ * PATH, a canonical path whose NR_COMPS components start at the
+ * offsets in COMPS (see canonicalize_path). If there is one, return
+ * an opaque pointer to its configuration data, and set *NR_MATCHED to
+ * the number of components of PATH it covers, *ALIASNAME to its name
+ * and *ROOT to its "path" setting (which may be NULL). Otherwise
+ * return NULL.
+ */
+extern void *cfg_find_alias (void *host_ptr, const char *path,
+			     const int *comps, int nr_comps, int *nr_matched,
+			     const char **aliasname, const char **root);
+
+/* Settings which are needed for every request. These are worked out
+ * for the main configuration, each host and each alias when the
+ * configuration file is read, so that handlers don't have to look up
+ * and parse strings.
+ */
+struct cfg_settings
+{
+  int flags;			/* Boolean settings, see below. */
+  int expires_ok;		/* Is there a valid "expires" setting? */
+  int expires_delta;		/* If so, seconds to add to the time. */
+  const char *maintainer;	/* "maintainer", or "(no maintainer)". */
+  const char *compress_types;	/* "compress types", or NULL. */
+  int compress_min_size;	/* "compress min size". */
+  int compress_max_size;	/* "compress max size". */
+};
+
+#define CFG_EXEC_SO  0x0001	/* "exec so" */
+#define CFG_EXEC     0x0002	/* "exec" */
+#define CFG_SHOW     0x0004	/* "show" */
+#define CFG_LIST     0x0008	/* "list" */
+
+/* Return the settings for HOST_PTR and ALIAS_PTR, either of which may
+ * be NULL, as for CFG_GET_STRING.
+ */
+extern const struct cfg_settings *cfg_get_settings (void *host_ptr,
+						    void *alias_ptr);
+
 /* Return the configuration string named KEY.
  *
  * HOST_PTR and ALIAS_PTR may be optionally given to narrow the search
@@ -58,4 +140,24 @@ extern int cfg_get_int (void *host_ptr, void *alias_ptr,
 extern int cfg_get_bool (void *host_ptr, void *alias_ptr,
 			 const char *key, int default_value);
 
+/* Configuration keys may be interned, and then looked up by number
+ * instead of by string, which is quicker. CFG_INTERN returns the same
+ * number each time it is called with the same KEY, for the life of the
+ * process, so the result can be kept in a static variable.
+ */
+typedef int cfg_key_t;
+
+extern cfg_key_t cfg_intern (const char *key);
+
+/* Like CFG_GET_STRING, CFG_GET_INT and CFG_GET_BOOL, but take an
+ * interned key.
+ */
+extern const char *cfg_get_string_key (void *host_ptr, void *alias_ptr,
+				       cfg_key_t key,
+				       const char *default_value);
+extern int cfg_get_int_key (void *host_ptr, void *alias_ptr,
+			    cfg_key_t key, int default_value);
+extern int cfg_get_bool_key (void *host_ptr, void *alias_ptr,
+			     cfg_key_t key, int default_value);
+
 #endif /* CFG_H */
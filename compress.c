@@ -0,0 +1,267 @@
+/* Compressed variants of cached files.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef USE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <pool.h>
+
+#include "compress.h"
+
+static const char *encoding_names[COMPRESS_NR_ENCODINGS] = {
+  "br", "zstd", "gzip"
+};
+
+/* Which encodings were compiled in. */
+static const int encoding_available[COMPRESS_NR_ENCODINGS] = {
+#ifdef USE_BROTLI
+  1,
+#else
+  0,
+#endif
+#ifdef USE_ZSTD
+  1,
+#else
+  0,
+#endif
+#ifdef USE_ZLIB
+  1,
+#else
+  0,
+#endif
+};
+
+static int parse_qvalue (const char **s);
+
+int
+compress_choose (const char *accept)
+{
+  int q[COMPRESS_NR_ENCODINGS];
+  int star = -1, best = -1, best_q = 0, i;
+  const char *s = accept;
+
+  for (i = 0; i < COMPRESS_NR_ENCODINGS; ++i) q[i] = -1;
+
+  /* Parse the header, which looks like "gzip;q=1.0, br, *;q=0". The
+   * q-values are held as integers in thousandths.
+   */
+  while (*s)
+    {
+      const char *name;
+      int len, qv = 1000;
+
+      while (*s == ' ' || *s == '\t' || *s == ',') s++;
+      name = s;
+      while (*s && *s != ',' && *s != ';' && *s != ' ' && *s != '\t') s++;
+      len = s - name;
+
+      /* Parameters. Only q is interesting. */
+      while (*s && *s != ',')
+	{
+	  if (*s == ';')
+	    {
+	      s++;
+	      while (*s == ' ' || *s == '\t') s++;
+	      if ((*s == 'q' || *s == 'Q') && s[1] == '=')
+		{
+		  s += 2;
+		  qv = parse_qvalue (&s);
+		}
+	    }
+	  else
+	    s++;
+	}
+
+      if (len == 1 && name[0] == '*')
+	star = qv;
+      else if ((len == 4 && strncasecmp (name, "gzip", 4) == 0) ||
+	       (len == 6 && strncasecmp (name, "x-gzip", 6) == 0))
+	q[COMPRESS_GZIP] = qv;
+      else if (len == 2 && strncasecmp (name, "br", 2) == 0)
+	q[COMPRESS_BR] = qv;
+      else if (len == 4 && strncasecmp (name, "zstd", 4) == 0)
+	q[COMPRESS_ZSTD] = qv;
+    }
+
+  /* Pick the encoding with the highest q-value. Ties go to the
+   * encoding listed first in our order of preference.
+   */
+  for (i = 0; i < COMPRESS_NR_ENCODINGS; ++i)
+    {
+      int qi = q[i] >= 0 ? q[i] : (star >= 0 ? star : 0);
+
+      if (encoding_available[i] && qi > best_q)
+	{
+	  best = i;
+	  best_q = qi;
+	}
+    }
+
+  return best;
+}
+
+/* Parse a q-value ("0", "0.5", "1.000", ...) into thousandths. */
+static int
+parse_qvalue (const char **s)
+{
+  const char *t = *s;
+  int v = 0, scale = 100;
+
+  if (*t >= '0' && *t <= '9')
+    v = (*t++ - '0') * 1000;
+
+  if (*t == '.')
+    for (t++; *t >= '0' && *t <= '9'; ++t)
+      {
+	v += (*t - '0') * scale;
+	scale /= 10;
+      }
+
+  *s = t;
+  return v > 1000 ? 1000 : v;
+}
+
+const char *
+compress_encoding_name (int encoding)
+{
+  return encoding_names[encoding];
+}
+
+void *
+compress_buffer (pool pool, int encoding, const void *data, size_t len,
+		 size_t *out_len)
+{
+  switch (encoding)
+    {
+#ifdef USE_ZLIB
+    case COMPRESS_GZIP:
+      {
+	z_stream z;
+	void *out;
+	size_t bound;
+	int r;
+
+	memset (&z, 0, sizeof z);
+
+	/* windowBits + 16 selects the gzip wrapper rather than zlib. */
+	if (deflateInit2 (&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+			  Z_DEFAULT_STRATEGY) != Z_OK)
+	  return 0;
+
+	bound = deflateBound (&z, len);
+	out = pmalloc (pool, bound);
+
+	z.next_in = (Bytef *) data;
+	z.avail_in = len;
+	z.next_out = out;
+	z.avail_out = bound;
+
+	r = deflate (&z, Z_FINISH);
+	*out_len = z.total_out;
+	deflateEnd (&z);
+
+	return r == Z_STREAM_END ? out : 0;
+      }
+#endif
+
+#ifdef USE_BROTLI
+    case COMPRESS_BR:
+      {
+	size_t n = BrotliEncoderMaxCompressedSize (len);
+	void *out;
+
+	if (n == 0) return 0;
+	out = pmalloc (pool, n);
+
+	/* Nothing else runs while we are compressing, so use a quality
+	 * which is quick rather than one which gives the smallest result.
+	 */
+	if (!BrotliEncoderCompress (5, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+				    len, data, &n, out))
+	  return 0;
+
+	*out_len = n;
+	return out;
+      }
+#endif
+
+#ifdef USE_ZSTD
+    case COMPRESS_ZSTD:
+      {
+	size_t n = ZSTD_compressBound (len), r;
+	void *out;
+
+	out = pmalloc (pool, n);
+	r = ZSTD_compress (out, n, data, len, 3);
+	if (ZSTD_isError (r)) return 0;
+
+	*out_len = r;
+	return out;
+      }
+#endif
+    }
+
+  return 0;
+}
+
+int
+compress_type_matches (const char *types, const char *mime_type)
+{
+  const char *s = types, *t;
+  int len, mlen = strlen (mime_type);
+
+  while (*s)
+    {
+      while (*s == ' ' || *s == '\t' || *s == '\n') s++;
+      t = s;
+      while (*s && *s != ' ' && *s != '\t' && *s != '\n') s++;
+      len = s - t;
+
+      if (len == 0) break;
+
+      if (len == mlen && strncasecmp (t, mime_type, len) == 0)
+	return 1;
+
+      /* A wildcard such as "text/ *" (without the space). */
+      if (len >= 2 && t[len-2] == '/' && t[len-1] == '*' &&
+	  mlen > len - 1 && strncasecmp (t, mime_type, len - 1) == 0)
+	return 1;
+    }
+
+  return 0;
+}
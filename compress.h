@@ -0,0 +1,57 @@
+/* Compressed variants of cached files.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include "config.h"
+
+#include <pool.h>
+
+/* Content codings, in order of preference when the browser likes
+ * them equally. Only those for which the library was available at
+ * configure time are ever chosen.
+ */
+#define COMPRESS_BR           0
+#define COMPRESS_ZSTD         1
+#define COMPRESS_GZIP         2
+#define COMPRESS_NR_ENCODINGS 3
+
+/* Choose a content coding from the Accept-Encoding header ACCEPT.
+ * Returns -1 if the file should be sent uncompressed.
+ */
+extern int compress_choose (const char *accept);
+
+/* Return the name of ENCODING, as sent in the Content-Encoding header. */
+extern const char *compress_encoding_name (int encoding);
+
+/* Compress LEN bytes at DATA using ENCODING. The result is allocated
+ * in POOL and its length is returned in *OUT_LEN. Returns NULL if
+ * the data could not be compressed.
+ */
+extern void *compress_buffer (pool pool, int encoding, const void *data, size_t len, size_t *out_len);
+
+/* Return true if MIME_TYPE appears in TYPES, a whitespace-separated
+ * list of MIME types. An entry such as "text/ *"
+ * (without the space) matches every subtype.
+ */
+extern int compress_type_matches (const char *types, const char *mime_type);
+
+#endif /* COMPRESS_H */
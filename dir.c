@@ -57,6 +57,8 @@
 #include "errors.h"
 #include "cfg.h"
 #include "re.h"
+#include "statcache.h"
+#include "status.h"
 #include "dir.h"
 
 static void choose_icon (process_rq p,
@@ -97,7 +99,7 @@ dir_serve (process_rq p)
    * the request to that file.
    */
   index_file = psprintf (p->pool, "%s/index.html", p->file_path);
-  if (stat (index_file, &index_statbuf) == 0 &&
+  if (statcache_stat (index_file, &index_statbuf) == 0 &&
       S_ISREG (index_statbuf.st_mode))
     {
       /* Update the request structure appropriately. */
@@ -110,9 +112,11 @@ dir_serve (process_rq p)
     }
 
   /* Are we allowed to generate a directory listing? */
-  if (!cfg_get_bool (p->host, p->alias, "list", 0))
+  if (!(cfg_get_settings (p->host, p->alias)->flags & CFG_LIST))
     return bad_request_error (p, "directory listing not allowed");
 
+  status_counters.dir_listings++;
+
   /* Yes: read the files into a local vector. */
   dir = opendir (p->file_path);
   if (dir == 0)
@@ -209,7 +213,8 @@ choose_icon (process_rq p,
   if (S_ISREG (statbuf->st_mode))
     {
       const char *mime_type = 0;
-      const char *icon_str;
+      const char *icon_str = 0;
+      char key[256];
       vector v;
 
       /* Get the file extension and map it to a MIME type. */
@@ -227,23 +232,20 @@ choose_icon (process_rq p,
 	  return;
 	}
 
-      /* If there a icon specified for this MIME type? */
-      icon_str = cfg_get_string (p->host, p->alias,
-				 psprintf (p->pool, "icon for %s", mime_type),
-				 0);
+      /* If there a icon specified for this MIME type? This is done
+       * for every file in the directory, so the keys are built on the
+       * stack rather than in the pool.
+       */
+      if (snprintf (key, sizeof key, "icon for %s", mime_type) < sizeof key)
+	icon_str = cfg_get_string (p->host, p->alias, key, 0);
       if (!icon_str)
 	{
 	  /* Try looking for an icon for class / * instead. */
-	  v = pstrcsplit (p->pool, mime_type, '/');
-	  if (vector_size (v) >= 1)
-	    {
-	      const char *mime_class;
-
-	      vector_get (v, 0, mime_class);
-	      icon_str = cfg_get_string (p->host, p->alias,
-					 psprintf (p->pool, "icon for %s/*",
-						   mime_class), 0);
-	    }
+	  int len = strcspn (mime_type, "/");
+
+	  if (snprintf (key, sizeof key, "icon for %.*s/*", len, mime_type)
+	      < sizeof key)
+	    icon_str = cfg_get_string (p->host, p->alias, key, 0);
 	}
 
       if (!icon_str)
@@ -281,10 +283,11 @@ standard_icon (process_rq p, const char *name,
 	       const char **icon, const char **icon_alt,
 	       int *icon_width, int *icon_height)
 {
-  const char *icon_str;
+  const char *icon_str = 0;
+  char key[64];
 
-  icon_str = cfg_get_string (p->host, p->alias,
-			     psprintf (p->pool, "%s icon", name), 0);
+  if (snprintf (key, sizeof key, "%s icon", name) < sizeof key)
+    icon_str = cfg_get_string (p->host, p->alias, key, 0);
   if (!icon_str)
     {
       unknown_icon (p, icon, icon_alt, icon_width, icon_height);
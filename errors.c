@@ -37,8 +37,7 @@ bad_request_error (process_rq p, const char *text)
   int close;
   const char *maintainer;
 
-  maintainer = cfg_get_string (p->host, p->alias,
-			       "maintainer", "(no maintainer)"); /* XXX */
+  maintainer = cfg_get_settings (p->host, p->alias)->maintainer;
 
   http_response = new_http_response (p->pool, p->http_request, p->io,
 				     500, "Internal server error");
@@ -81,8 +80,7 @@ file_not_found_error (process_rq p)
   int close;
   const char *maintainer;
 
-  maintainer = cfg_get_string (p->host, p->alias,
-			       "maintainer", "(no maintainer)");
+  maintainer = cfg_get_settings (p->host, p->alias)->maintainer;
 
   http_response = new_http_response (p->pool, p->http_request, p->io,
 				     404, "File or directory not found");
@@ -54,6 +54,7 @@
 
 #include "process_rq.h"
 #include "errors.h"
+#include "status.h"
 #include "exec.h"
 
 #ifndef HAVE_SETENV
@@ -92,6 +93,8 @@ exec_file (process_rq p)
   io_handle to_io, from_io;
   const char *content_length;
 
+  status_counters.cgi_scripts++;
+
   content_length
     = http_request_get_header (p->http_request, "Content-Length");
 
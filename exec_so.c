@@ -42,6 +42,7 @@
 #include "rws_request.h"
 #include "process_rq.h"
 #include "errors.h"
+#include "status.h"
 #include "cfg.h"
 #include "exec_so.h"
 
@@ -89,6 +90,8 @@ exec_so_file (process_rq p)
   rws_request rq;
   struct fn_result fn_result;
 
+  status_counters.so_scripts++;
+
   /* Check our cache of currently loaded .so files to see if this one
    * has already been loaded.
    */
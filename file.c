@@ -22,6 +22,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
 
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
@@ -55,6 +56,11 @@
 #include <alloca.h>
 #endif
 
+#if defined(HAVE_SENDFILE) && defined(HAVE_SYS_SENDFILE_H)
+#include <sys/sendfile.h>
+#define USE_SENDFILE 1
+#endif
+
 #include <pool.h>
 #include <vector.h>
 #include <hash.h>
@@ -72,34 +78,93 @@
 #include "exec_so.h"
 #include "cfg.h"
 #include "re.h"
+#include "compress.h"
+#include "watch.h"
+#include "status.h"
+#include "timecache.h"
+#include "lru.h"
 #include "file.h"
 
-/* XXX This code doesn't deal with the "If-Modified-Since" header
- * correctly. It is important to get this fixed in the near future.
- *
- * Similarly the code should send "Last-Modified" headers.
- */
-
 struct hash_key
 {
   dev_t st_dev;
   ino_t st_ino;
 };
 
+/* A compressed copy of a cached file. */
+struct file_variant
+{
+  void *addr;
+  size_t size;
+  const char *etag;
+  const char *content_length;	/* SIZE, as a string. */
+  int tried;			/* Set once we have tried to build it. */
+};
+
 struct file_info
 {
   struct pool *pool;
   struct stat statbuf;
   void *addr;
+
+  /* Cache validators, sent as the ETag and Last-Modified headers. */
+  const char *etag;
+  const char *last_modified;
+
+  /* The MIME type comes from the file's name, so we remember the name
+   * and type used when the entry was made. A hit under a different
+   * name looks up the type again.
+   */
+  const char *name;
+  const char *mime_type;
+
+  /* The value of the Content-Length header. */
+  const char *content_length;
+
+  /* Compressed variants, indexed by COMPRESS_*. These are built the
+   * first time a browser asks for them, and live until the entry is
+   * invalidated (ie. until the file changes).
+   */
+  struct file_variant variants[COMPRESS_NR_ENCODINGS];
+  off_t variants_size;		/* Total size of all variants. */
+
+  /* These are only set in the copy of an entry used to serve a
+   * single request.
+   */
+  const char *encoding;		/* Content-Encoding, or NULL. */
+  int vary;			/* Send "Vary: Accept-Encoding". */
+
+  /* The path the file was opened by. If WATCHED is set then the
+   * watcher thread will invalidate this entry as soon as the file at
+   * PATH changes, so we don't need to check the modification time on
+   * each hit.
+   */
+  const char *path;
+  int watched;
 };
 
 static pool file_pool = 0;
 
-#define MAX_MMAP_SIZE (10 * 1024 * 1024)
-#define MAX_ENTRIES   100
-#define MAX_SIZE      (100 * 1024 * 1024)
+/* Limits on the cache. These are read from the configuration file
+ * by file_init.
+ */
+static int max_entries = 100;
+static off_t max_size = 100 * 1024 * 1024;
+static off_t max_mmap_size = 10 * 1024 * 1024;
 
-static int total_size = 0;
+/* Use sendfile(2) for files which are not served from the cache. */
+static int use_sendfile = 1;
+
+/* If set, the list of cached files is saved in this file every
+ * MANIFEST_INTERVAL seconds and at shutdown, and reloaded at startup.
+ * WARM_UP_RATE limits how fast (in KB/s) files are read when
+ * reloading, or 0 for no limit.
+ */
+static const char *manifest = 0;
+static int manifest_interval = 300;
+static int warm_up_rate = 10240;
+
+static off_t total_size = 0;
 static int nr_entries = 0;
 
 /* This is the list of files (of type struct file_info) which are
@@ -108,20 +173,54 @@ static int nr_entries = 0;
  */
 static vector file_list = 0;
 
-/* This is a list of integers indexing into file_list, stored in LRU
- * order. Element 0 is the oldest, and larger numbered elements are
- * younger. New entries are pushed onto the back of this list.
+/* The offsets of the live entries in file_list, in LRU order, and of
+ * the blank entries ready for reuse. New entries and cache hits are
+ * made the youngest.
  */
-static vector lru_list = 0;
+static lru file_lru = 0;
 
 /* This hash of { device, inode } -> integer maps unique stat information
  * about files to their offset in the file_list array above.
  */
 static hash file_hash = 0;
 
+/* This maps the paths of watched entries to their offset in file_list. */
+static shash file_paths = 0;
+
+/* A single byte range requested with the Range header. */
+struct byte_range
+{
+  off_t start, length;
+};
+
+/* Requests with more ranges than this get the whole file instead. */
+#define MAX_RANGES 32
+
+static void warm_up (void *);
+static void save_manifest_periodically (void *);
 static void invalidate_entry (void *);
+static void make_room (int entries, off_t bytes, int keep);
+static void describe_file (process_rq p, struct file_info *info, const struct stat *statbuf, const char *mime_type);
+static int add_entry (int fd, const char *path, const struct stat *path_statbuf, const char *name, const char *mime_type);
+static int serve_cached (process_rq p, int offset, const char *mime_type);
+static const struct file_variant *get_variant (int offset, int encoding);
+static int is_compressible (const struct cfg_settings *settings, off_t size, const char *mime_type);
 static int quickly_serve_it (process_rq p, const struct file_info *info, const char *mime_type);
-static int slowly_serve_it (process_rq p, int fd, const char *mime_type);
+static int slowly_serve_it (process_rq p, int fd, const struct file_info *info, const char *mime_type);
+static int is_not_modified (process_rq p, const struct file_info *info);
+static int not_modified (process_rq p, const struct file_info *info);
+static void validator_headers (const struct file_info *info, http_response http_response);
+static const char *get_mime_type (pool pool, const char *name);
+static const char *format_length (pool pool, off_t size);
+static const char *make_etag (pool pool, const struct stat *statbuf);
+static const char *http_date (pool pool, time_t t);
+static int parse_http_date (const char *str, time_t *t);
+static int get_ranges (process_rq p, const struct file_info *info, vector *ranges_ret);
+static int parse_number (const char **s, unsigned long long *n);
+static int partial_content (process_rq p, const struct file_info *info, int fd, const char *mime_type, vector ranges);
+static int range_not_satisfiable (process_rq p, const struct file_info *info);
+static int send_range (process_rq p, const struct file_info *info, int fd, off_t offset, off_t length);
+static int send_fd (process_rq p, int fd, off_t offset, off_t length);
 static void expires_header (process_rq p, http_response http_response);
 
 /* Initialize structures. */
@@ -130,25 +229,38 @@ file_init ()
 {
   file_pool = new_subpool (global_pool);
   file_list = new_vector (file_pool, struct file_info);
-  lru_list = new_vector (file_pool, int);
+  file_lru = new_lru (file_pool);
   file_hash = new_hash (file_pool, struct hash_key, int);
+  file_paths = new_shash (file_pool, int);
+
+  /* Cache limits. Sizes are given in kilobytes. */
+  max_entries = cfg_get_int (0, 0, "file cache entries", 100);
+  max_size = (off_t) cfg_get_int (0, 0, "file cache size", 100 * 1024) * 1024;
+  max_mmap_size = (off_t) cfg_get_int (0, 0, "max mmap size", 10 * 1024) * 1024;
+
+  use_sendfile = cfg_get_bool (0, 0, "sendfile", 1);
+
+  manifest = cfg_get_string (0, 0, "file cache manifest", 0);
+  if (manifest) manifest = pstrdup (file_pool, manifest);
+  manifest_interval = cfg_get_int (0, 0, "file cache manifest interval", 300);
+  warm_up_rate = cfg_get_int (0, 0, "file cache warm up rate", 10240);
 }
 
 int
 file_serve (process_rq p)
 {
-  vector extv;
-  const char *mime_type = 0;
+  const char *mime_type;
   int offset, fd;
   struct hash_key key;
   struct file_info info;
-  void *m;
+  struct stat statbuf;
+  const struct cfg_settings *settings = cfg_get_settings (p->host, p->alias);
 
   /* If this file is an executable .so file, and we are allowed to
    * run .so files from this directory, then it's a shared object
    * script. Hand it off to exec_so.c to run.
    */
-  if (cfg_get_bool (p->host, p->alias, "exec so", 0) &&
+  if ((settings->flags & CFG_EXEC_SO) &&
       prematch (p->pool, p->remainder, re_so, 0) &&
       (p->statbuf.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH)))
     return exec_so_file (p);
@@ -157,26 +269,16 @@ file_serve (process_rq p)
    * this directory, then it's a CGI script. Hand it off to exec.c to
    * run.
    */
-  if (cfg_get_bool (p->host, p->alias, "exec", 0) &&
+  if ((settings->flags & CFG_EXEC) &&
       (p->statbuf.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH)))
     return exec_file (p);
 
   /* Are we permitted to show files in this directory? */
-  if (!cfg_get_bool (p->host, p->alias, "show", 0))
+  if (!(settings->flags & CFG_SHOW))
     return bad_request_error (p,
 			      "you are not permitted to view files "
 			      "in this directory");
 
-  /* Map the file's name to its MIME type. */
-  if ((extv = prematch (p->pool, p->remainder, re_ext, 0)) != 0)
-    {
-      char *ext;
-
-      vector_get (extv, 1, ext);
-      mime_type = mime_types_get_type (ext);
-    }
-  if (!mime_type) mime_type = "application/octet-stream"; /* Default. */
-
   /* Check the hash to see if we know anything about this file already. */
   memset (&key, 0, sizeof key);
   key.st_dev = p->statbuf.st_dev;
@@ -187,13 +289,45 @@ file_serve (process_rq p)
       vector_get (file_list, offset, info);
 
       /* ... but has the file on disk changed since we mapped it? */
-      if (info.statbuf.st_mtime == p->statbuf.st_mtime)
-	return quickly_serve_it (p, &info, mime_type);
+      if (info.watched ||
+	  (info.statbuf.st_mtime == p->statbuf.st_mtime &&
+	   info.statbuf.st_size == p->statbuf.st_size))
+	{
+	  /* Move it to the young end of the LRU list. */
+	  lru_touch (file_lru, offset);
+	  status_counters.cache_hits++;
+
+	  /* Usually the file is requested by the same name every time,
+	   * so we already know its MIME type.
+	   */
+	  if (strcmp (p->remainder, info.name) == 0)
+	    mime_type = info.mime_type;
+	  else
+	    mime_type = get_mime_type (p->pool, p->remainder);
+
+	  return serve_cached (p, offset, mime_type);
+	}
       else
-	/* File has changed: invalidate the cache entry. */
-	delete_pool (info.pool);
+	{
+	  /* File has changed: invalidate the cache entry. */
+	  delete_pool (info.pool);
+	  status_counters.cache_invalidations++;
+	}
     }
 
+  status_counters.cache_misses++;
+
+  mime_type = get_mime_type (p->pool, p->remainder);
+
+  /* Work out the validators for the file. P->STATBUF may come from the
+   * stat cache, but that is good enough to answer a conditional GET.
+   */
+  describe_file (p, &info, &p->statbuf, mime_type);
+
+  /* Conditional GET: we don't need to open the file at all. */
+  if (is_not_modified (p, &info))
+    return not_modified (p, &info);
+
   /* Try to open the file. */
   fd = open (p->file_path, O_RDONLY);
   if (fd < 0) return file_not_found_error (p);
@@ -203,54 +337,256 @@ file_serve (process_rq p)
    */
   if (fcntl (fd, F_SETFD, FD_CLOEXEC) < 0) { perror ("fcntl"); exit (1); }
 
-  /* If the file's too large, don't mmap it. */
-  if (p->statbuf.st_size > MAX_MMAP_SIZE)
-    return slowly_serve_it (p, fd, mime_type);
+  /* The response must describe the file we actually send, not what the
+   * stat cache remembers about it.
+   */
+  if (fstat (fd, &statbuf) == -1 || !S_ISREG (statbuf.st_mode))
+    {
+      close (fd);
+      return file_not_found_error (p);
+    }
+  describe_file (p, &info, &statbuf, mime_type);
 
-  /* Map the file into memory. */
-  m = mmap (0, p->statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
-  if (m == MAP_FAILED)
-    return slowly_serve_it (p, fd, mime_type);
+  /* Map the file and add it to the cache. If the file is too large,
+   * or can't be mapped, send it from the file descriptor instead.
+   */
+  offset = add_entry (fd, p->file_path, &statbuf, p->remainder, mime_type);
+  if (offset == -1)
+    return slowly_serve_it (p, fd, &info, mime_type);
 
   close (fd);
 
-  /* Evict some entries from the cache to make enough room. */
-  while (nr_entries >= MAX_ENTRIES || total_size >= MAX_SIZE)
+  /* Serve it from memory. */
+  return serve_cached (p, offset, mime_type);
+}
+
+/* Fill in INFO, for a response which is not served from the cache,
+ * from STATBUF.
+ */
+static void
+describe_file (process_rq p, struct file_info *info,
+	       const struct stat *statbuf, const char *mime_type)
+{
+  const struct cfg_settings *settings = cfg_get_settings (p->host, p->alias);
+
+  memset (info, 0, sizeof *info);
+  info->statbuf = *statbuf;
+  info->etag = make_etag (p->pool, statbuf);
+  info->last_modified = http_date (p->pool, statbuf->st_mtime);
+  info->vary = is_compressible (settings, statbuf->st_size, mime_type);
+}
+
+/* Map the open file FD into memory and add it to the cache. PATH is
+ * the file's path, PATH_STATBUF the (possibly cached) result of stat on
+ * it, and NAME and MIME_TYPE the name it was requested under and that
+ * name's type. Returns the new entry's offset, or -1 if the file is too
+ * large for the cache or cannot be mapped. FD is not closed.
+ */
+static int
+add_entry (int fd, const char *path, const struct stat *path_statbuf,
+	   const char *name, const char *mime_type)
+{
+  struct file_info info, *entry;
+  struct hash_key key;
+  struct stat lstatbuf, fd_statbuf;
+  const struct stat *statbuf = &fd_statbuf;
+  int offset, watched;
+  void *m;
+
+  /* If the file's too large, don't mmap it. */
+  if (path_statbuf->st_size > max_mmap_size)
+    return -1;
+
+  /* Ask to be told when the file changes. We can only do this if the
+   * path we have is the file's real name, since a change to the target
+   * of a symbolic link is reported in the target's directory. This is
+   * done before looking at the file, so no change can be missed.
+   */
+  watched = lstat (path, &lstatbuf) == 0 && S_ISREG (lstatbuf.st_mode) &&
+    watch_file (path) == 0;
+
+  /* PATH_STATBUF may come from the stat cache and be out of date, so
+   * map the file as it is now.
+   */
+  if (fstat (fd, &fd_statbuf) == -1 ||
+      !S_ISREG (fd_statbuf.st_mode) ||
+      fd_statbuf.st_size > max_mmap_size)
+    goto not_added;
+
+  /* The caller looked for the file using PATH_STATBUF, so the file we
+   * have open may be in the cache already, for example under another
+   * name, or if it has been renamed to PATH since. Use that entry if it
+   * is up to date, otherwise replace it.
+   */
+  memset (&key, 0, sizeof key);
+  key.st_dev = statbuf->st_dev;
+  key.st_ino = statbuf->st_ino;
+  if (hash_get (file_hash, key, offset))
     {
-      vector_get (lru_list, 0, offset);
-      vector_get (file_list, offset, info);
-      delete_pool (info.pool);
+      vector_get_ptr (file_list, offset, entry);
+      if (entry->statbuf.st_mtime == statbuf->st_mtime &&
+	  entry->statbuf.st_size == statbuf->st_size)
+	{
+	  if (watched) watch_release (path);
+	  lru_touch (file_lru, offset);
+	  return offset;
+	}
+
+      delete_pool (entry->pool);
+      status_counters.cache_invalidations++;
     }
 
+  /* Map the file into memory. */
+  m = mmap (0, statbuf->st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (m == MAP_FAILED)
+    goto not_added;
+
+  /* Evict some entries from the cache to make enough room. */
+  make_room (1, statbuf->st_size, -1);
+
   /* Add the entry to the cache. */
+  memset (&info, 0, sizeof info);
   info.pool = new_subpool (file_pool);
-  info.statbuf = p->statbuf;
+  info.statbuf = *statbuf;
   info.addr = m;
+  info.etag = make_etag (info.pool, statbuf);
+  info.last_modified = http_date (info.pool, statbuf->st_mtime);
+  info.path = pstrdup (info.pool, path);
+  info.name = pstrdup (info.pool, name);
+  info.mime_type = pstrdup (info.pool, mime_type);
+  info.content_length = format_length (info.pool, statbuf->st_size);
   nr_entries++;
-  total_size += p->statbuf.st_size;
+  total_size += statbuf->st_size;
+
+  /* Reuse a blank entry if there is one. */
+  offset = lru_new_slot (file_lru);
+  if (offset < vector_size (file_list))
+    vector_replace (file_list, offset, info);
+  else
+    vector_push_back (file_list, info);
 
-  for (offset = 0; offset < vector_size (file_list); ++offset)
+  hash_insert (file_hash, key, offset);
+
+  if (watched)
     {
-      struct file_info entry;
+      vector_get_ptr (file_list, offset, entry);
+      entry->watched = 1;
+      shash_insert (file_paths, entry->path, offset);
+    }
+
+  pool_register_cleanup_fn (info.pool, invalidate_entry, (void *) (long) offset);
+
+  return offset;
+
+ not_added:
+  if (watched) watch_release (path);
+  return -1;
+}
+
+/* Serve the file in cache entry OFFSET, choosing a compressed variant
+ * if this alias compresses files of this type and the browser accepts
+ * one of our encodings.
+ */
+static int
+serve_cached (process_rq p, int offset, const char *mime_type)
+{
+  struct file_info info;
+  const struct file_variant *v;
+  const struct cfg_settings *settings = cfg_get_settings (p->host, p->alias);
+  const char *accept;
+  int encoding;
 
-      vector_get (file_list, offset, entry);
-      if (entry.pool == 0)
+  vector_get (file_list, offset, info);
+
+  if (is_compressible (settings, info.statbuf.st_size, mime_type))
+    {
+      info.vary = 1;
+
+      /* Byte ranges are always served from the uncompressed file,
+       * which is what a browser resuming a download expects.
+       */
+      accept = http_request_get_header (p->http_request, "Accept-Encoding");
+      if (accept &&
+	  !http_request_get_header (p->http_request, "Range") &&
+	  (encoding = compress_choose (accept)) >= 0 &&
+	  (v = get_variant (offset, encoding)) != 0)
 	{
-	  vector_replace (file_list, offset, info);
-	  goto added_it;
+	  info.addr = v->addr;
+	  info.statbuf.st_size = v->size;
+	  info.etag = v->etag;
+	  info.content_length = v->content_length;
+	  info.encoding = compress_encoding_name (encoding);
 	}
     }
 
-  vector_push_back (file_list, info);
+  /* Conditional GET: the validators are kept in the cache entry,
+   * so no need to touch the file to answer this.
+   */
+  if (is_not_modified (p, &info))
+    return not_modified (p, &info);
 
- added_it:
-  hash_insert (file_hash, key, offset);
-  vector_push_back (lru_list, offset);
+  return quickly_serve_it (p, &info, mime_type);
+}
+
+/* Does this alias compress files of this size and type? If so, every
+ * response for the file must say "Vary: Accept-Encoding", whether or
+ * not it is compressed, so that caches don't mix up the encodings.
+ */
+static int
+is_compressible (const struct cfg_settings *settings, off_t size,
+		 const char *mime_type)
+{
+  return settings->compress_types &&
+    size >= settings->compress_min_size &&
+    size <= settings->compress_max_size &&
+    compress_type_matches (settings->compress_types, mime_type);
+}
 
-  pool_register_cleanup_fn (info.pool, invalidate_entry, (void *) offset);
+/* Return the compressed variant of cache entry OFFSET, building it if
+ * this is the first time it has been asked for. Returns NULL if the
+ * file cannot be (usefully) compressed with ENCODING.
+ */
+static const struct file_variant *
+get_variant (int offset, int encoding)
+{
+  struct file_info *entry;
+  struct file_variant *v;
+  pool tmp;
+  void *data;
+  size_t size;
 
-  /* Serve it from memory. */
-  return quickly_serve_it (p, &info, mime_type);
+  vector_get_ptr (file_list, offset, entry);
+  v = &entry->variants[encoding];
+
+  if (!v->tried)
+    {
+      v->tried = 1;
+
+      /* Compress into a temporary pool, and only keep the result if
+       * it is actually smaller than the original.
+       */
+      tmp = new_subpool (file_pool);
+      data = compress_buffer (tmp, encoding,
+			      entry->addr, entry->statbuf.st_size, &size);
+      if (data && size < entry->statbuf.st_size)
+	{
+	  v->addr = pmemdup (entry->pool, data, size);
+	  v->size = size;
+	  v->etag = psprintf (entry->pool, "%.*s-%s\"",
+			      (int) strlen (entry->etag) - 1, entry->etag,
+			      compress_encoding_name (encoding));
+	  v->content_length = format_length (entry->pool, size);
+
+	  /* The variant counts against the cache size. */
+	  entry->variants_size += size;
+	  total_size += size;
+	}
+      delete_pool (tmp);
+
+      make_room (0, 0, offset);
+    }
+
+  return v->addr ? v : 0;
 }
 
 static int
@@ -258,19 +594,36 @@ quickly_serve_it (process_rq p, const struct file_info *info,
 		  const char *mime_type)
 {
   http_response http_response;
+  vector ranges;
   int cl;
 
-  /* Not changed, so it's a real cache hit. */
+  /* Not changed, so it's a real cache hit. Was a part of it requested? */
+  switch (get_ranges (p, info, &ranges))
+    {
+    case 1: return partial_content (p, info, -1, mime_type, ranges);
+    case -1: return range_not_satisfiable (p, info);
+    }
+
+  /* The headers have to go through pthrlib one at a time, since it
+   * writes the status line and its own headers, and it needs to see
+   * Content-Length to keep the connection open. They are only copied
+   * into the IO handle's buffer here, and go out with the body when the
+   * buffer is flushed.
+   */
   http_response = new_http_response (p->pool, p->http_request, p->io,
 				     200, "OK");
   http_response_send_headers (http_response,
 			      /* Content type. */
 			      "Content-Type", mime_type,
 			      /* Content length. */
-			      "Content-Length", pitoa (p->pool,
-						       info->statbuf.st_size),
+			      "Content-Length", info->content_length,
+			      "Accept-Ranges", "bytes",
 			      /* End of headers. */
 			      NULL);
+  validator_headers (info, http_response);
+  if (info->encoding)
+    http_response_send_header (http_response,
+			       "Content-Encoding", info->encoding);
   expires_header (p, http_response);
   cl = http_response_end_headers (http_response);
 
@@ -282,15 +635,27 @@ quickly_serve_it (process_rq p, const struct file_info *info,
 }
 
 static int
-slowly_serve_it (process_rq p, int fd, const char *mime_type)
+slowly_serve_it (process_rq p, int fd, const struct file_info *info,
+		 const char *mime_type)
 {
   http_response http_response;
-  const int n = 4096;
-  char *buffer = alloca (n);
-  int r, cl;
+  vector ranges;
+  int cl;
 
-  /* Cannot memory map this file. Instead fall back to just reading
-   * it and sending it back through the socket.
+  switch (get_ranges (p, info, &ranges))
+    {
+    case 1:
+      cl = partial_content (p, info, fd, mime_type, ranges);
+      close (fd);
+      return cl;
+    case -1:
+      close (fd);
+      return range_not_satisfiable (p, info);
+    }
+
+  /* Cannot memory map this file. Instead fall back to sending it
+   * straight from the file descriptor. (Note that the file may be
+   * larger than an int).
    */
   http_response = new_http_response (p->pool, p->http_request, p->io,
 				     200, "OK");
@@ -298,128 +663,808 @@ slowly_serve_it (process_rq p, int fd, const char *mime_type)
 			      /* Content type. */
 			      "Content-Type", mime_type,
 			      /* Content length. */
-			      "Content-Length", pitoa (p->pool,
-						       p->statbuf.st_size),
+			      "Content-Length",
+			      psprintf (p->pool, "%llu",
+					(unsigned long long)
+					info->statbuf.st_size),
+			      "Accept-Ranges", "bytes",
 			      /* End of headers. */
 			      NULL);
+  validator_headers (info, http_response);
   expires_header (p, http_response);
   cl = http_response_end_headers (http_response);
 
-  if (http_request_is_HEAD (p->http_request)) return cl;
+  /* If the file has shrunk since we looked at it, we can't send the
+   * promised number of bytes, so the connection has to be closed.
+   */
+  if (!http_request_is_HEAD (p->http_request) &&
+      send_fd (p, fd, 0, info->statbuf.st_size) == -1)
+    cl = 1;
+
+  close (fd);
 
-  while ((r = read (fd, buffer, n)) > 0)
+  return cl;
+}
+
+/* Parse the Range and If-Range headers. Returns 0 if the whole file
+ * should be sent, 1 if *RANGES_RET has been set to a vector of struct
+ * byte_range, or -1 if none of the requested ranges can be satisfied.
+ * Syntactically invalid Range headers are ignored (RFC 2616 section
+ * 14.35.1).
+ */
+static int
+get_ranges (process_rq p, const struct file_info *info, vector *ranges_ret)
+{
+  const char *range, *if_range;
+  unsigned long long size = info->statbuf.st_size, first, last;
+  vector specs, ranges;
+  int i;
+
+  if (http_request_method (p->http_request) != HTTP_METHOD_GET &&
+      !http_request_is_HEAD (p->http_request))
+    return 0;
+
+  range = http_request_get_header (p->http_request, "Range");
+  if (!range) return 0;
+
+  /* If-Range: only send part of the file if the browser's copy is
+   * current, otherwise send the whole thing. Entity tags must match
+   * strongly, dates exactly.
+   */
+  if_range = http_request_get_header (p->http_request, "If-Range");
+  if (if_range)
     {
-      io_fwrite (buffer, r, 1, p->io);
+      if (if_range[0] == '"' || strncmp (if_range, "W/", 2) == 0)
+	{
+	  if (strcmp (if_range, info->etag) != 0) return 0;
+	}
+      else if (strcmp (if_range, info->last_modified) != 0)
+	return 0;
     }
 
-  if (r < 0)
+  if (strncasecmp (range, "bytes=", 6) != 0) return 0;
+
+  specs = pstrcsplit (p->pool, range + 6, ',');
+  if (vector_size (specs) == 0 || vector_size (specs) > MAX_RANGES)
+    return 0;
+
+  ranges = new_vector (p->pool, struct byte_range);
+
+  for (i = 0; i < vector_size (specs); ++i)
     {
-      perror ("read");
+      char *spec;
+      const char *s;
+      struct byte_range r;
+
+      vector_get (specs, i, spec);
+      s = ptrim (spec);
+
+      if (*s == '-')		/* Suffix range: "-N" is the last N bytes. */
+	{
+	  s++;
+	  if (!parse_number (&s, &last) || *s) return 0;
+
+	  if (last == 0 || size == 0) continue; /* Unsatisfiable. */
+	  if (last > size) last = size;
+
+	  r.start = size - last;
+	  r.length = last;
+	}
+      else			/* "FIRST-LAST" or "FIRST-". */
+	{
+	  if (!parse_number (&s, &first) || *s++ != '-') return 0;
+	  if (*s == '\0')
+	    last = size;
+	  else if (!parse_number (&s, &last) || *s || last < first)
+	    return 0;
+
+	  if (first >= size) continue; /* Unsatisfiable. */
+	  if (last >= size) last = size - 1;
+
+	  r.start = first;
+	  r.length = last - first + 1;
+	}
+
+      vector_push_back (ranges, r);
     }
 
-  close (fd);
+  if (vector_size (ranges) == 0) return -1;
+
+  *ranges_ret = ranges;
+  return 1;
+}
+
+/* Parse a decimal number at *S, updating *S to point after it. */
+static int
+parse_number (const char **s, unsigned long long *n)
+{
+  const char *t = *s;
+
+  *n = 0;
+  while (*t >= '0' && *t <= '9')
+    {
+      if (*n > 100000000000000000ULL) return 0; /* Overflow. */
+      *n = *n * 10 + (*t - '0');
+      t++;
+    }
+
+  if (t == *s) return 0;
+  *s = t;
+  return 1;
+}
+
+/* Send a 206 response. A single range is sent as-is, multiple ranges
+ * are sent as multipart/byteranges (RFC 2616 section 19.2). If FD is
+ * -1 then the data comes from the cache entry's mapping.
+ */
+static int
+partial_content (process_rq p, const struct file_info *info, int fd,
+		 const char *mime_type, vector ranges)
+{
+  http_response http_response;
+  struct byte_range r;
+  const char *boundary, *part_header, *trailer;
+  unsigned long long size = info->statbuf.st_size, length;
+  vector part_headers;
+  int i, cl;
+
+  if (vector_size (ranges) == 1)
+    {
+      vector_get (ranges, 0, r);
+
+      http_response = new_http_response (p->pool, p->http_request, p->io,
+					 206, "Partial content");
+      http_response_send_headers (http_response,
+				  /* Content type. */
+				  "Content-Type", mime_type,
+				  /* Content length. */
+				  "Content-Length",
+				  psprintf (p->pool, "%llu",
+					    (unsigned long long) r.length),
+				  "Content-Range",
+				  psprintf (p->pool, "bytes %llu-%llu/%llu",
+					    (unsigned long long) r.start,
+					    (unsigned long long)
+					    (r.start + r.length - 1),
+					    size),
+				  "Accept-Ranges", "bytes",
+				  /* End of headers. */
+				  NULL);
+      if (info->encoding)
+	http_response_send_header (http_response,
+				   "Content-Encoding", info->encoding);
+      validator_headers (info, http_response);
+      expires_header (p, http_response);
+      cl = http_response_end_headers (http_response);
+
+      if (http_request_is_HEAD (p->http_request)) return cl;
+
+      if (send_range (p, info, fd, r.start, r.length) == -1)
+	cl = 1;
+
+      return cl;
+    }
+
+  /* Build the header for each part first, so that we can work out
+   * the total length of the response.
+   */
+  boundary = psprintf (p->pool, "%08lx%08lx",
+		       (unsigned long) random (), (unsigned long) random ());
+  part_headers = new_vector (p->pool, const char *);
+  length = 0;
+
+  for (i = 0; i < vector_size (ranges); ++i)
+    {
+      vector_get (ranges, i, r);
+
+      part_header = psprintf (p->pool,
+			      CRLF "--%s" CRLF
+			      "Content-Type: %s" CRLF
+			      "Content-Range: bytes %llu-%llu/%llu" CRLF
+			      CRLF,
+			      boundary, mime_type,
+			      (unsigned long long) r.start,
+			      (unsigned long long) (r.start + r.length - 1),
+			      size);
+      vector_push_back (part_headers, part_header);
+      length += strlen (part_header) + r.length;
+    }
+
+  trailer = psprintf (p->pool, CRLF "--%s--" CRLF, boundary);
+  length += strlen (trailer);
+
+  http_response = new_http_response (p->pool, p->http_request, p->io,
+				     206, "Partial content");
+  http_response_send_headers (http_response,
+			      /* Content type. */
+			      "Content-Type",
+			      psprintf (p->pool,
+					"multipart/byteranges; boundary=%s",
+					boundary),
+			      /* Content length. */
+			      "Content-Length",
+			      psprintf (p->pool, "%llu", length),
+			      "Accept-Ranges", "bytes",
+			      /* End of headers. */
+			      NULL);
+  if (info->encoding)
+    http_response_send_header (http_response,
+			       "Content-Encoding", info->encoding);
+  validator_headers (info, http_response);
+  expires_header (p, http_response);
+  cl = http_response_end_headers (http_response);
+
+  if (http_request_is_HEAD (p->http_request)) return cl;
+
+  for (i = 0; i < vector_size (ranges); ++i)
+    {
+      vector_get (ranges, i, r);
+      vector_get (part_headers, i, part_header);
+
+      io_fputs (part_header, p->io);
+      if (send_range (p, info, fd, r.start, r.length) == -1)
+	return 1;
+    }
+
+  io_fputs (trailer, p->io);
 
   return cl;
 }
 
-/* Send the Expires header, if configured. */
-static void
-expires_header (process_rq p, http_response http_response)
+static int
+range_not_satisfiable (process_rq p, const struct file_info *info)
 {
-  const char *expires;
-  char pm, unit;
-  int length;
+  http_response http_response;
 
-  expires = cfg_get_string (p->host, p->alias, "expires", 0);
-  if (!expires) return;
+  http_response = new_http_response (p->pool, p->http_request, p->io,
+				     416, "Requested range not satisfiable");
+  http_response_send_headers (http_response,
+			      /* Content length. */
+			      "Content-Length", "0",
+			      "Content-Range",
+			      psprintf (p->pool, "bytes */%llu",
+					(unsigned long long)
+					info->statbuf.st_size),
+			      /* End of headers. */
+			      NULL);
+  validator_headers (info, http_response);
+  return http_response_end_headers (http_response);
+}
 
-  /* Parse the configuration string. */
-  if (sscanf (expires, "%c%d%c", &pm, &length, &unit) == 3 &&
-      (pm == '+' || pm == '-') &&
-      length > 0 &&
-      (unit == 's' || unit == 'm' || unit == 'h' ||
-       unit == 'd' || unit == 'y'))
+/* Send part of a file, either from the cache entry's mapping or, if
+ * the file is not mapped, from file descriptor FD. Returns 0, or -1
+ * if it could not all be sent.
+ */
+static int
+send_range (process_rq p, const struct file_info *info, int fd,
+	    off_t offset, off_t length)
+{
+  if (info->addr)
     {
-      time_t t;
-      struct tm *tm;
-      char header[64];
+      io_fwrite ((const char *) info->addr + offset, length, 1, p->io);
+      return 0;
+    }
+  else
+    return send_fd (p, fd, offset, length);
+}
 
-      time (&t);
+/* Send LENGTH bytes of file FD, starting at OFFSET, to the client.
+ * Returns 0, or -1 if the file was shorter than that or could not be
+ * read or sent.
+ */
+static int
+send_fd (process_rq p, int fd, off_t offset, off_t length)
+{
+  const int n = 4096;
+  char *buffer;
+  int r = 0;
 
-      if (pm == '+')
+#ifdef USE_SENDFILE
+  if (use_sendfile)
+    {
+      ssize_t s;
+      int sent = 0;
+
+      /* The headers are still sitting in the IO handle's buffer, so
+       * they must go out first.
+       */
+      io_fflush (p->io);
+
+      /* The socket is non-blocking (pthrlib requires this), so when the
+       * socket buffer fills up we sleep in the reactor until it is
+       * writable again, letting other threads run in the meantime.
+       */
+      while (length > 0)
 	{
-	  switch (unit)
+	  s = sendfile (p->sock, fd, &offset,
+			length > 0x7ffff000 ? 0x7ffff000 : length);
+	  if (s > 0)
 	    {
-	    case 's': t += length; break;
-	    case 'm': t += length * 60; break;
-	    case 'h': t += length * (60 * 60); break;
-	    case 'd': t += length * (60 * 60 * 24); break;
-	    case 'y': t += length * (60 * 60 * 24 * 366); break;
+	      length -= s;
+	      sent = 1;
 	    }
-	}
-      else
-	{
-	  switch (unit)
+	  else if (s == 0)	/* File was truncated under us. */
+	    return -1;
+	  else if (errno == EAGAIN)
+	    pth_wait_writable (p->sock);
+	  else if (errno == EINTR)
+	    continue;
+	  else if (!sent && (errno == EINVAL || errno == ENOSYS))
+	    break;		/* Not supported for this file: fall back. */
+	  else
 	    {
-	    case 's': t -= length; break;
-	    case 'm': t -= length * 60; break;
-	    case 'h': t -= length * (60 * 60); break;
-	    case 'd': t -= length * (60 * 60 * 24); break;
-	    case 'y': t -= length * (60 * 60 * 24 * 366); break;
+	      perror ("sendfile");
+	      return -1;
 	    }
 	}
 
-      tm = gmtime (&t);
-      strftime (header, sizeof header, "%a, %d %b %Y %H:%M:%S GMT", tm);
+      if (length == 0) return 0;
+    }
+#endif
 
-      http_response_send_header (http_response, "Expires", header);
+  /* Fall back to just reading the file and sending it back through
+   * the socket.
+   */
+  if (lseek (fd, offset, SEEK_SET) == (off_t) -1)
+    {
+      perror ("lseek");
+      return -1;
     }
-  else
+
+  buffer = alloca (n);
+  while (length > 0 &&
+	 (r = read (fd, buffer, length > n ? n : length)) > 0)
+    {
+      io_fwrite (buffer, r, 1, p->io);
+      length -= r;
+    }
+
+  if (r < 0)
     {
-      fprintf (stderr, "file.c: expires_header: cannot parse '%s'\n",
-	       expires);
+      perror ("read");
+      return -1;
     }
+
+  return length > 0 ? -1 : 0;
+}
+
+/* Check the If-None-Match and If-Modified-Since headers against the
+ * file's validators. Returns true if the browser's copy is current.
+ * If-None-Match takes precedence (RFC 2616 section 14.26).
+ */
+static int
+is_not_modified (process_rq p, const struct file_info *info)
+{
+  const char *inm, *ims;
+  time_t t;
+
+  if (http_request_method (p->http_request) != HTTP_METHOD_GET &&
+      !http_request_is_HEAD (p->http_request))
+    return 0;
+
+  inm = http_request_get_header (p->http_request, "If-None-Match");
+  if (inm)
+    {
+      vector v = pstrcsplit (p->pool, inm, ',');
+      int i;
+
+      for (i = 0; i < vector_size (v); ++i)
+	{
+	  char *tag;
+
+	  vector_get (v, i, tag);
+	  tag = ptrim (tag);
+
+	  /* Weak comparison is allowed for GET and HEAD. */
+	  if (strncmp (tag, "W/", 2) == 0) tag += 2;
+
+	  if (strcmp (tag, "*") == 0 || strcmp (tag, info->etag) == 0)
+	    return 1;
+	}
+      return 0;
+    }
+
+  ims = http_request_get_header (p->http_request, "If-Modified-Since");
+  if (ims && parse_http_date (ims, &t))
+    return info->statbuf.st_mtime <= t;
+
+  return 0;
+}
+
+/* Send a body-less 304 response. */
+static int
+not_modified (process_rq p, const struct file_info *info)
+{
+  http_response http_response;
+
+  http_response = new_http_response (p->pool, p->http_request, p->io,
+				     304, "Not modified");
+  validator_headers (info, http_response);
+  expires_header (p, http_response);
+  return http_response_end_headers (http_response);
+}
+
+/* Work out the MIME type of a file from its NAME. */
+static const char *
+get_mime_type (pool pool, const char *name)
+{
+  vector extv;
+  const char *mime_type = 0;
+
+  if ((extv = prematch (pool, name, re_ext, 0)) != 0)
+    {
+      char *ext;
+
+      vector_get (extv, 1, ext);
+      mime_type = mime_types_get_type (ext);
+    }
+  if (!mime_type) mime_type = "application/octet-stream"; /* Default. */
+
+  return mime_type;
+}
+
+/* Format SIZE for the Content-Length header. */
+static const char *
+format_length (pool pool, off_t size)
+{
+  return psprintf (pool, "%llu", (unsigned long long) size);
+}
+
+static void
+validator_headers (const struct file_info *info, http_response http_response)
+{
+  http_response_send_headers (http_response,
+			      "Last-Modified", info->last_modified,
+			      "ETag", info->etag,
+			      NULL);
+  if (info->vary)
+    http_response_send_header (http_response, "Vary", "Accept-Encoding");
+}
+
+/* The entity tag is derived from the same information that we use
+ * to validate cache entries, plus the inode and size.
+ */
+static const char *
+make_etag (pool pool, const struct stat *statbuf)
+{
+  return psprintf (pool, "\"%lx-%lx-%lx-%lx\"",
+		   (unsigned long) statbuf->st_dev,
+		   (unsigned long) statbuf->st_ino,
+		   (unsigned long) statbuf->st_size,
+		   (unsigned long) statbuf->st_mtime);
+}
+
+/* Format time T as an RFC 1123 date. */
+static const char *
+http_date (pool pool, time_t t)
+{
+  struct tm *tm;
+  char date[64];
+
+  tm = gmtime (&t);
+  strftime (date, sizeof date, "%a, %d %b %Y %H:%M:%S GMT", tm);
+  return pstrdup (pool, date);
+}
+
+/* Parse an HTTP date in any of the three formats permitted by RFC 2616
+ * section 3.3.1. Returns true if successful.
+ */
+static int
+parse_http_date (const char *str, time_t *t)
+{
+  static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  char mon[4];
+  int day, month, year, hour, min, sec;
+  long days;
+  const char *m;
+
+  if (sscanf (str, "%*[a-zA-Z], %d %3s %d %d:%d:%d",
+	      &day, mon, &year, &hour, &min, &sec) == 6)
+    ;				/* RFC 1123 */
+  else if (sscanf (str, "%*[a-zA-Z], %d-%3s-%d %d:%d:%d",
+		   &day, mon, &year, &hour, &min, &sec) == 6)
+    year += year < 70 ? 2000 : 1900; /* RFC 850 */
+  else if (sscanf (str, "%*[a-zA-Z] %3s %d %d:%d:%d %d",
+		   mon, &day, &hour, &min, &sec, &year) == 6)
+    ;				/* asctime */
+  else
+    return 0;
+
+  mon[3] = '\0';
+  if (strlen (mon) != 3 || (m = strstr (months, mon)) == 0 ||
+      (m - months) % 3 != 0)
+    return 0;
+  month = (m - months) / 3 + 1;
+
+  if (day < 1 || day > 31 || hour > 23 || min > 59 || sec > 60 ||
+      year < 1970)
+    return 0;
+
+  /* Days since the epoch (proleptic Gregorian calendar), avoiding the
+   * non-portable timegm(3).
+   */
+  if (month <= 2) year--;
+  days = (long) year * 365 + year / 4 - year / 100 + year / 400
+    + (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1
+    - 719468;
+
+  *t = (time_t) days * 86400 + hour * 3600 + min * 60 + sec;
+  return 1;
+}
+
+/* Send the Expires and Cache-Control headers, if configured. */
+static void
+expires_header (process_rq p, http_response http_response)
+{
+  const struct cfg_settings *settings = cfg_get_settings (p->host, p->alias);
+  const struct timecache_expires *e;
+
+  if (!settings->expires_ok) return;
+
+  e = timecache_get_expires (settings->expires_delta);
+  http_response_send_header (http_response, "Expires", e->expires);
+  http_response_send_header (http_response, "Cache-Control", e->cache_control);
 }
 
 static void
 invalidate_entry (void *offset_ptr)
 {
-  int offset = (int) offset_ptr;
-  int i, j;
-  struct file_info info;
+  int offset = (int) (long) offset_ptr, path_offset;
+  struct file_info *info;
   struct hash_key key;
 
-  /* Pull the invalidated entry out of the file_list. */
-  vector_get (file_list, offset, info);
+  vector_get_ptr (file_list, offset, info);
 
   /* Remove from the file_hash. */
   memset (&key, 0, sizeof key);
-  key.st_dev = info.statbuf.st_dev;
-  key.st_ino = info.statbuf.st_ino;
+  key.st_dev = info->statbuf.st_dev;
+  key.st_ino = info->statbuf.st_ino;
   if (!hash_erase (file_hash, key)) abort ();
 
-  /* Remove from the lru_list. */
-  for (i = 0; i < vector_size (lru_list); ++i)
+  /* Remove from file_paths, unless a newer entry for the same path
+   * has already replaced this one.
+   */
+  if (info->watched)
     {
-      vector_get (lru_list, i, j);
-
-      if (j == offset)
-	{
-	  vector_erase (lru_list, i);
-	  goto found_it;
-	}
+      if (shash_get (file_paths, info->path, path_offset) &&
+	  path_offset == offset)
+	shash_erase (file_paths, info->path);
+      watch_release (info->path);
     }
-  abort ();
 
- found_it:
   /* Unmap the memory. */
-  munmap (info.addr, info.statbuf.st_size);
-
-  /* Invalidate this entry in the file_list. */
-  info.pool = 0;
-  vector_replace (file_list, offset, info);
+  munmap (info->addr, info->statbuf.st_size);
 
   /* Update counters. */
   nr_entries--;
-  total_size -= info.statbuf.st_size;
+  total_size -= info->statbuf.st_size + info->variants_size;
+
+  /* Invalidate this entry in the file_list, and free its offset for
+   * reuse.
+   */
+  info->pool = 0;
+  info->addr = 0;
+  info->path = 0;
+  info->watched = 0;
+  lru_free_slot (file_lru, offset);
+}
+
+void
+file_invalidate_path (const char *path)
+{
+  struct file_info *entry;
+  int offset;
+
+  if (shash_get (file_paths, path, offset))
+    {
+      vector_get_ptr (file_list, offset, entry);
+      delete_pool (entry->pool);
+      status_counters.cache_invalidations++;
+    }
+}
+
+void
+file_get_stats (struct file_stats *stats)
+{
+  stats->nr_entries = nr_entries;
+  stats->max_entries = max_entries;
+  stats->total_size = total_size;
+  stats->max_size = max_size;
+}
+
+void
+file_flush ()
+{
+  struct file_info *entry;
+  int offset;
+
+  while ((offset = lru_oldest (file_lru)) >= 0)
+    {
+      vector_get_ptr (file_list, offset, entry);
+      delete_pool (entry->pool);
+    }
+}
+
+void
+file_warm_up ()
+{
+  pseudothread pth;
+
+  if (!manifest) return;
+
+  pth = new_pseudothread (new_subpool (global_pool), warm_up, 0, "warm up");
+  pth_start (pth);
+
+  if (manifest_interval > 0)
+    {
+      pth = new_pseudothread (new_subpool (global_pool),
+			      save_manifest_periodically, 0, "manifest");
+      pth_start (pth);
+    }
+}
+
+/* Reload the files listed in the manifest into the cache, in the
+ * background, while the server is already taking requests.
+ */
+static void
+warm_up (void *vp)
+{
+  FILE *fp;
+  char line[8192], *path, *name, *end;
+  unsigned long long size;
+  long mtime;
+  struct stat statbuf;
+  struct hash_key key;
+  struct file_info *entry;
+  pool tmp;
+  int fd, offset, nr = 0;
+
+  pth_set_name ("rws cache warm up");
+
+  fp = fopen (manifest, "r");
+  if (fp == 0)
+    {
+      if (errno != ENOENT) perror (manifest);
+      return;
+    }
+
+  while (fgets (line, sizeof line, fp))
+    {
+      /* Each line is: size TAB mtime TAB path TAB name. */
+      size = strtoull (line, &end, 10);
+      if (*end != '\t') continue;
+      mtime = strtol (end + 1, &end, 10);
+      if (*end != '\t') continue;
+      path = end + 1;
+      if ((name = strchr (path, '\t')) == 0) continue;
+      *name++ = '\0';
+      if ((end = strchr (name, '\n')) == 0) continue;
+      *end = '\0';
+
+      /* Skip files which have changed, or which are cached already. */
+      if (stat (path, &statbuf) == -1 ||
+	  !S_ISREG (statbuf.st_mode) ||
+	  statbuf.st_size != size ||
+	  statbuf.st_mtime != mtime)
+	continue;
+
+      memset (&key, 0, sizeof key);
+      key.st_dev = statbuf.st_dev;
+      key.st_ino = statbuf.st_ino;
+      if (hash_exists (file_hash, key))
+	continue;
+
+      fd = open (path, O_RDONLY);
+      if (fd < 0) continue;
+      if (fcntl (fd, F_SETFD, FD_CLOEXEC) < 0) { perror ("fcntl"); exit (1); }
+
+      tmp = new_subpool (global_pool);
+      offset = add_entry (fd, path, &statbuf, name,
+			  get_mime_type (tmp, name));
+      delete_pool (tmp);
+      close (fd);
+      if (offset == -1) continue;
+
+      /* Start reading the file in now, rather than on the first hit. */
+#ifdef MADV_WILLNEED
+      vector_get_ptr (file_list, offset, entry);
+      madvise (entry->addr, statbuf.st_size, MADV_WILLNEED);
+#endif
+      nr++;
+
+      /* Pace ourselves, and let other threads run in between files. */
+      pth_millisleep (warm_up_rate > 0
+		      ? size * 1000 / ((unsigned long long) warm_up_rate * 1024)
+		      : 0);
+    }
+
+  fclose (fp);
+
+  fprintf (stderr, "rws: warmed up file cache with %d files\n", nr);
+}
+
+static void
+save_manifest_periodically (void *vp)
+{
+  pth_set_name ("rws cache manifest");
+
+  for (;;)
+    {
+      pth_sleep (manifest_interval);
+      file_save_manifest ();
+    }
+}
+
+void
+file_save_manifest ()
+{
+  FILE *fp;
+  char *tmpname;
+  struct file_info *entry;
+  int offset;
+
+  if (!manifest) return;
+
+  /* Workers may all be saving the manifest at once, so the temporary
+   * file has the process ID in its name.
+   */
+  tmpname = alloca (strlen (manifest) + 32);
+  sprintf (tmpname, "%s.%d.tmp", manifest, (int) getpid ());
+
+  fp = fopen (tmpname, "w");
+  if (fp == 0)
+    {
+      perror (tmpname);
+      return;
+    }
+
+  /* Write the oldest entries first, so that reloading the manifest
+   * leaves the LRU list in the same order.
+   */
+  for (offset = lru_oldest (file_lru); offset >= 0;
+       offset = lru_next (file_lru, offset))
+    {
+      vector_get_ptr (file_list, offset, entry);
+
+      if (strpbrk (entry->path, "\t\n") || strpbrk (entry->name, "\t\n"))
+	continue;
+
+      fprintf (fp, "%llu\t%ld\t%s\t%s\n",
+	       (unsigned long long) entry->statbuf.st_size,
+	       (long) entry->statbuf.st_mtime,
+	       entry->path, entry->name);
+    }
+
+  /* Replace the old manifest atomically. */
+  if (fclose (fp) == EOF || rename (tmpname, manifest) == -1)
+    {
+      perror (manifest);
+      unlink (tmpname);
+    }
+}
+
+/* Evict entries, oldest first, until there is room in the cache for
+ * ENTRIES more entries and BYTES more bytes. The entry at offset KEEP
+ * (if not -1) is never evicted.
+ */
+static void
+make_room (int entries, off_t bytes, int keep)
+{
+  struct file_info *oldest;
+  int victim;
+
+  while (nr_entries + entries > max_entries ||
+	 total_size + bytes > max_size)
+    {
+      /* Evict the oldest entry, passing over KEEP. */
+      victim = lru_oldest (file_lru);
+      if (victim >= 0 && victim == keep)
+	victim = lru_next (file_lru, victim);
+      if (victim < 0)
+	break;
+
+      vector_get_ptr (file_list, victim, oldest);
+      delete_pool (oldest->pool);
+      status_counters.cache_evictions++;
+    }
 }
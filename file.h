@@ -25,8 +25,34 @@
 
 #include "process_rq.h"
 
+/* The size of the file cache, for the status page. */
+struct file_stats
+{
+  int nr_entries, max_entries;
+  off_t total_size, max_size;
+};
+
 extern void file_init (void);
 
 extern int file_serve (process_rq p);
 
+/* Drop PATH from the file cache, if it is there. This is called by the
+ * watcher thread when PATH changes on disk.
+ */
+extern void file_invalidate_path (const char *path);
+
+/* Drop everything from the file cache. */
+extern void file_flush (void);
+
+/* If 'file cache manifest' is set, start reloading the files listed in
+ * it in the background, and start saving it periodically. Call this
+ * from the server startup function.
+ */
+extern void file_warm_up (void);
+
+/* Save the list of cached files to the manifest now. */
+extern void file_save_manifest (void);
+
+extern void file_get_stats (struct file_stats *stats);
+
 #endif /* FILE_H */
@@ -0,0 +1,282 @@
+/* Persistent connections.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <poll.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#if defined(HAVE_EPOLL_CREATE) && defined(HAVE_SYS_EPOLL_H)
+#include <sys/epoll.h>
+#define USE_EPOLL 1
+#endif
+
+#include <pool.h>
+
+#include <pthr_pseudothread.h>
+#include <pthr_iolib.h>
+#include <pthr_wait_queue.h>
+
+#include "cfg.h"
+#include "status.h"
+#include "timecache.h"
+#include "keepalive.h"
+
+/* Doubly linked list of idle connections, oldest first. */
+static process_rq idle_head = 0, idle_tail = 0;
+static int nr_idle = 0;
+
+static void idle_add (process_rq p);
+static void idle_remove (process_rq p);
+static void close_idle (process_rq p);
+static int poll_idle (process_rq p, int timeout);
+
+#ifdef USE_EPOLL
+/* Idle connections are parked in a single epoll set, watched by one
+ * thread, rather than each thread polling its own socket. This keeps
+ * thousands of idle connections out of the main loop's poll set. The
+ * parked threads sleep on their own wait queues until the parker
+ * thread sees their socket become readable or their time run out.
+ */
+static int epoll_fd = -1;
+static int parker_failed = 0;
+
+static int start_parker (void);
+static void parker (void *);
+static int park (process_rq p);
+#endif
+
+int
+keepalive_wait (process_rq p)
+{
+  int timeout, max_idle;
+
+  /* If the client has sent the next request already, don't wait. */
+  if (io_get_inbufcount (p->io) > 0)
+    return 1;
+
+  timeout = cfg_get_int (0, 0, "keepalive timeout", 15);
+  max_idle = cfg_get_int (0, 0, "max idle connections", 1000);
+
+  p->idle_deadline = timecache_now () + timeout;
+  idle_add (p);
+
+  /* Too many idle connections? Close the oldest. */
+  if (max_idle > 0 && nr_idle > max_idle)
+    close_idle (idle_head);
+
+#ifdef USE_EPOLL
+  if (epoll_fd >= 0 || (!parker_failed && start_parker () == 0))
+    return park (p);
+#endif
+
+  return poll_idle (p, timeout);
+}
+
+/* Wait for P by polling its socket in its own thread. */
+static int
+poll_idle (process_rq p, int timeout)
+{
+  struct pollfd pfd;
+  int r;
+
+  pfd.fd = p->sock;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  r = pth_poll (&pfd, 1, timeout * 1000);
+
+  if (p->idle_prev || idle_head == p)
+    idle_remove (p);
+
+  if (r == 0)
+    {
+      status_counters.idle_timeouts++;
+      return 0;
+    }
+
+  return 1;
+}
+
+/* Close the idle connection P, which is not this thread's. */
+static void
+close_idle (process_rq p)
+{
+  idle_remove (p);
+  status_counters.idle_closes++;
+
+#ifdef USE_EPOLL
+  if (p->idle_result == -1)	/* Parked. */
+    {
+      p->idle_result = 0;
+      wq_wake_up (p->idle_wq);
+      return;
+    }
+#endif
+
+  /* Shutting down the socket wakes its thread up with end of file,
+   * and it closes normally.
+   */
+  shutdown (p->sock, SHUT_RD);
+}
+
+#ifdef USE_EPOLL
+
+static int
+start_parker ()
+{
+  pseudothread pth;
+
+  epoll_fd = epoll_create (1024);
+  if (epoll_fd == -1)
+    {
+      perror ("epoll_create");
+      parker_failed = 1;
+      return -1;
+    }
+  if (fcntl (epoll_fd, F_SETFD, FD_CLOEXEC) < 0)
+    { perror ("fcntl"); exit (1); }
+
+  pth = new_pseudothread (new_subpool (global_pool), parker, 0, "parker");
+  pth_start (pth);
+  return 0;
+}
+
+/* Park P until its socket is readable, its time is up, or it is closed
+ * to make room for other idle connections.
+ */
+static int
+park (process_rq p)
+{
+  struct epoll_event ev;
+
+  if (p->idle_wq == 0)
+    p->idle_wq = new_wait_queue (pth_get_pool (p->pth));
+
+  ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT;
+  ev.data.ptr = p;
+  if (epoll_ctl (epoll_fd, EPOLL_CTL_ADD, p->sock, &ev) == -1)
+    {
+      perror ("epoll_ctl");
+      return poll_idle (p, p->idle_deadline - timecache_now ());
+    }
+
+  p->idle_result = -1;
+  while (p->idle_result == -1)
+    wq_sleep_on (p->idle_wq);
+
+  epoll_ctl (epoll_fd, EPOLL_CTL_DEL, p->sock, &ev);
+
+  return p->idle_result;
+}
+
+#define MAX_EVENTS 64
+
+static void
+parker (void *vp)
+{
+  struct epoll_event events[MAX_EVENTS];
+  struct pollfd pfd;
+  process_rq p;
+  time_t now;
+  int i, n;
+
+  pth_set_name ("rws idle connection parker");
+
+  for (;;)
+    {
+      /* Wake up at least once a second to time out idle connections. */
+      pfd.fd = epoll_fd;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      pth_poll (&pfd, 1, 1000);
+
+      while ((n = epoll_wait (epoll_fd, events, MAX_EVENTS, 0)) > 0)
+	{
+	  for (i = 0; i < n; ++i)
+	    {
+	      p = events[i].data.ptr;
+	      if (p->idle_result == -1)
+		{
+		  idle_remove (p);
+		  p->idle_result = 1;
+		  wq_wake_up (p->idle_wq);
+		}
+	    }
+	  if (n < MAX_EVENTS) break;
+	}
+
+      /* The list is in order of when connections became idle, so the
+       * ones whose time is up are at the front.
+       */
+      now = timecache_now ();
+      while (idle_head && idle_head->idle_deadline <= now)
+	{
+	  p = idle_head;
+	  idle_remove (p);
+	  if (p->idle_result == -1)
+	    {
+	      status_counters.idle_timeouts++;
+	      p->idle_result = 0;
+	      wq_wake_up (p->idle_wq);
+	    }
+	}
+    }
+}
+
+#endif /* USE_EPOLL */
+
+static void
+idle_add (process_rq p)
+{
+  p->idle_prev = idle_tail;
+  p->idle_next = 0;
+  if (idle_tail) idle_tail->idle_next = p;
+  else idle_head = p;
+  idle_tail = p;
+  nr_idle++;
+}
+
+static void
+idle_remove (process_rq p)
+{
+  if (p->idle_prev) p->idle_prev->idle_next = p->idle_next;
+  else idle_head = p->idle_next;
+  if (p->idle_next) p->idle_next->idle_prev = p->idle_prev;
+  else idle_tail = p->idle_prev;
+  p->idle_prev = p->idle_next = 0;
+  nr_idle--;
+}
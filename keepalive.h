@@ -0,0 +1,38 @@
+/* Persistent connections.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#ifndef KEEPALIVE_H
+#define KEEPALIVE_H
+
+#include "config.h"
+
+#include "process_rq.h"
+
+/* Wait for the next request on the persistent connection P, for up
+ * to 'keepalive timeout' seconds. Returns 1 if there is something to
+ * read (which might be end of file), or 0 if the connection has been
+ * idle for too long and should be closed.
+ *
+ * While it waits, P counts against 'max idle connections'. If there
+ * are too many idle connections then the oldest is closed.
+ */
+extern int keepalive_wait (process_rq p);
+
+#endif /* KEEPALIVE_H */
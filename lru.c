@@ -0,0 +1,157 @@
+/* Least recently used list of slots.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#include "config.h"
+
+#include <pool.h>
+#include <vector.h>
+
+#include "lru.h"
+
+/* The list is doubly linked through LINKS, which has an entry for every
+ * slot handed out so far. HEAD is the oldest slot and TAIL the
+ * youngest. Free slots are kept on a singly linked list starting at
+ * FREE, using only NEXT. -1 marks the end of a list.
+ */
+struct lru_links
+{
+  int prev, next;
+};
+
+struct lru
+{
+  vector links;
+  int head, tail, free;
+};
+
+lru
+new_lru (pool pool)
+{
+  lru l = pmalloc (pool, sizeof *l);
+
+  l->links = new_vector (pool, struct lru_links);
+  l->head = l->tail = l->free = -1;
+  return l;
+}
+
+/* Add SLOT, which is not in the list, to the young end. */
+static void
+push_back (lru l, int slot)
+{
+  struct lru_links *links, *other;
+
+  vector_get_ptr (l->links, slot, links);
+  links->prev = l->tail;
+  links->next = -1;
+
+  if (l->tail >= 0)
+    {
+      vector_get_ptr (l->links, l->tail, other);
+      other->next = slot;
+    }
+  else
+    l->head = slot;
+
+  l->tail = slot;
+}
+
+/* Remove SLOT from the list. */
+static void
+unlink_slot (lru l, int slot)
+{
+  struct lru_links *links, *other;
+
+  vector_get_ptr (l->links, slot, links);
+
+  if (links->prev >= 0)
+    {
+      vector_get_ptr (l->links, links->prev, other);
+      other->next = links->next;
+    }
+  else
+    l->head = links->next;
+
+  if (links->next >= 0)
+    {
+      vector_get_ptr (l->links, links->next, other);
+      other->prev = links->prev;
+    }
+  else
+    l->tail = links->prev;
+
+  links->prev = links->next = -1;
+}
+
+int
+lru_new_slot (lru l)
+{
+  struct lru_links *links, blank = { -1, -1 };
+  int slot;
+
+  if (l->free >= 0)
+    {
+      slot = l->free;
+      vector_get_ptr (l->links, slot, links);
+      l->free = links->next;
+    }
+  else
+    {
+      slot = vector_size (l->links);
+      vector_push_back (l->links, blank);
+    }
+
+  push_back (l, slot);
+  return slot;
+}
+
+void
+lru_free_slot (lru l, int slot)
+{
+  struct lru_links *links;
+
+  unlink_slot (l, slot);
+
+  vector_get_ptr (l->links, slot, links);
+  links->next = l->free;
+  l->free = slot;
+}
+
+void
+lru_touch (lru l, int slot)
+{
+  if (slot == l->tail) return;
+  unlink_slot (l, slot);
+  push_back (l, slot);
+}
+
+int
+lru_oldest (lru l)
+{
+  return l->head;
+}
+
+int
+lru_next (lru l, int slot)
+{
+  struct lru_links *links;
+
+  vector_get_ptr (l->links, slot, links);
+  return links->next;
+}
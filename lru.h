@@ -0,0 +1,55 @@
+/* Least recently used list of slots.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#ifndef LRU_H
+#define LRU_H
+
+#include <pool.h>
+
+/* An LRU list hands out slot numbers 0, 1, 2, ... which the caller
+ * uses as offsets into its own vector, and keeps the slots in use in
+ * order of last use. Slots which are given back are reused before new
+ * ones are made, so the caller's vector only grows when every slot is
+ * in use. All the operations take constant time.
+ */
+typedef struct lru *lru;
+
+extern lru new_lru (pool);
+
+/* Take a free slot, or a new one (which is the same as the number of
+ * slots handed out so far), and make it the youngest.
+ */
+extern int lru_new_slot (lru);
+
+/* Give back SLOT. */
+extern void lru_free_slot (lru, int slot);
+
+/* Make SLOT the youngest. */
+extern void lru_touch (lru, int slot);
+
+/* Return the oldest slot in use, or -1 if there are none. */
+extern int lru_oldest (lru);
+
+/* Return the next younger slot after SLOT, or -1 if SLOT is the
+ * youngest.
+ */
+extern int lru_next (lru, int slot);
+
+#endif /* LRU_H */
@@ -22,11 +22,16 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
 
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
 
+#ifdef HAVE_GETOPT_H
+#include <getopt.h>
+#endif
+
 #ifdef HAVE_SIGNAL_H
 #include <signal.h>
 #endif
@@ -43,14 +48,20 @@
 #include <sys/wait.h>
 #endif
 
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
 #ifdef HAVE_FCNTL_H
 #include <fcntl.h>
 #endif
 
 #include <pool.h>
+#include <vector.h>
 #include <pstring.h>
 #include <pre.h>
 
+#include <pthr_pseudothread.h>
 #include <pthr_http.h>
 #include <pthr_server.h>
 
@@ -61,17 +72,38 @@
 #include "process_rq.h"
 #include "rewrite.h"
 #include "re.h"
+#include "statcache.h"
+#include "watch.h"
+#include "status.h"
+#include "timecache.h"
+#include "workers.h"
 
 static void startup (int argc, char *argv[]);
 static void start_thread (int sock, void *data);
 static void catch_reload_signal (int sig);
 static void catch_quit_signal (int sig);
 static void catch_child_signal (int sig);
-static void reload_config (void);
+static int reload_config (void);
+static void make_signal_pipe (int fds[2]);
+static void start_reloader (void);
+static void reloader (void *);
+static void start_quitter (void);
+static void quitter (void *);
+static void set_signal_handlers (void);
 
 const char *config_path = "/etc/rws";
 FILE *access_log;
 
+/* The SIGHUP handler writes a byte to this pipe, and the reloader
+ * thread reads it and reloads the configuration.
+ */
+static int reload_fd[2] = { -1, -1 };
+
+/* Similarly the quit signals wake up the quitter thread, which saves
+ * the file cache manifest and exits.
+ */
+static int quit_fd[2] = { -1, -1 };
+
 const pcre *re_alias_start,
   *re_alias_end,
   *re_begin,
@@ -87,9 +119,13 @@ main (int argc, char *argv[])
 {
   const char *user, *name, *stderr_file;
   int c, stack_size;
-  struct sigaction sa;
   int foreground = 0;
   int debug = 0;
+  int compile_config = 0;
+  static const struct option long_options[] = {
+    { "compile-config", 0, 0, 'c' },
+    { 0, 0, 0, 0 }
+  };
 
   /* Initialise various shared regular expressions. */
   re_alias_start = precomp (global_pool, "^alias[[:space:]]+(.*)$", 0);
@@ -103,7 +139,7 @@ main (int argc, char *argv[])
   re_ws = precomp (global_pool, "[ \t]+", 0);
   re_comma = precomp (global_pool, "[,;]+", 0);
 
-  while ((c = getopt (argc, argv, "C:p:a:fd")) != -1)
+  while ((c = getopt_long (argc, argv, "C:p:a:fd", long_options, 0)) != -1)
     {
       switch (c)
 	{
@@ -127,16 +163,26 @@ main (int argc, char *argv[])
           debug = 1;
           break;
 
+	case 'c':
+	  compile_config = 1;
+	  break;
+
 	default:
-	  fprintf (stderr, "usage: rws [-d] [-f] [-a address] [-p port] [-C configpath]\n");
+	  fprintf (stderr, "usage: rws [-d] [-f] [-a address] [-p port] [-C configpath]\n"
+		   "       rws --compile-config [-C configpath]\n");
 	  exit (1);
 	}
     }
 
+  /* Just write the compiled configuration image? */
+  if (compile_config)
+    exit (cfg_compile_config (config_path) == 0 ? 0 : 1);
+
   /* Read configuration file. Do this early so we have configuration
    * data available for other initializations.
    */
-  reload_config ();
+  if (reload_config () == -1)
+    exit (1);
 
   /* Change the thread stack size? */
   stack_size = cfg_get_int (0, 0, "stack size", 0);
@@ -146,28 +192,17 @@ main (int argc, char *argv[])
   /* Initialize the file cache. */
   file_init ();
 
+  /* Start counting. */
+  status_init ();
+
+  /* Initialize the stat cache. */
+  statcache_init ();
+
   /* Initialize the shared object script cache. */
   exec_so_init ();
 
   /* Intercept signals. */
-  memset (&sa, 0, sizeof sa);
-  sa.sa_handler = catch_reload_signal;
-  sa.sa_flags = SA_RESTART;
-  sigaction (SIGHUP, &sa, 0);
-
-  sa.sa_handler = catch_quit_signal;
-  sigaction (SIGINT, &sa, 0);
-  sigaction (SIGQUIT, &sa, 0);
-  sigaction (SIGTERM, &sa, 0);
-
-  sa.sa_handler = catch_child_signal;
-  sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
-  sigaction (SIGCHLD, &sa, 0);
-
-  /* ... but ignore SIGPIPE errors. */
-  sa.sa_handler = SIG_IGN;
-  sa.sa_flags = SA_RESTART;
-  sigaction (SIGPIPE, &sa, 0);
+  set_signal_handlers ();
 
   /* Change user on startup. */
   user = cfg_get_string (0, 0, "user", "nobody");
@@ -210,6 +245,7 @@ static void
 startup (int argc, char *argv[])
 {
   FILE *access_log;
+  int nr_workers;
 
   /* Open the access log. */
   access_log
@@ -223,6 +259,40 @@ startup (int argc, char *argv[])
     { perror ("fcntl"); exit (1); }
 
   http_set_log_file (access_log);
+
+  /* In multi-process mode, this process becomes the master and only
+   * the workers carry on to serve requests. Each worker has its own
+   * threads and its own caches.
+   */
+  nr_workers = cfg_get_int (0, 0, "workers", 0);
+  if (nr_workers > 0)
+    {
+      /* A worker restarted after a SIGHUP must not serve the
+       * configuration the master read at startup.
+       */
+      if (workers_start (nr_workers) &&
+	  reload_config () == -1)
+	fprintf (stderr,
+		 "rws: errors in the new configuration, "
+		 "keeping the old one\n");
+      set_signal_handlers ();
+    }
+
+  /* Reload the configuration when we get SIGHUP, and quit cleanly
+   * on SIGINT, SIGQUIT and SIGTERM. Each worker has its own pipes, so
+   * this is done after starting them.
+   */
+  start_reloader ();
+  start_quitter ();
+
+  /* Keep the time of day, so that requests don't have to ask for it. */
+  timecache_init ();
+
+  /* Start watching for changes to cached files. */
+  watch_init ();
+
+  /* Reload the file cache from the last run. */
+  file_warm_up ();
 }
 
 static void
@@ -231,17 +301,57 @@ start_thread (int sock, void *data)
   (void) new_process_rq (sock);
 }
 
+static void
+set_signal_handlers ()
+{
+  struct sigaction sa;
+
+  memset (&sa, 0, sizeof sa);
+  sa.sa_handler = catch_reload_signal;
+  sa.sa_flags = SA_RESTART;
+  sigaction (SIGHUP, &sa, 0);
+
+  sa.sa_handler = catch_quit_signal;
+  sigaction (SIGINT, &sa, 0);
+  sigaction (SIGQUIT, &sa, 0);
+  sigaction (SIGTERM, &sa, 0);
+
+  sa.sa_handler = catch_child_signal;
+  sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+  sigaction (SIGCHLD, &sa, 0);
+
+  /* ... but ignore SIGPIPE errors. */
+  sa.sa_handler = SIG_IGN;
+  sa.sa_flags = SA_RESTART;
+  sigaction (SIGPIPE, &sa, 0);
+}
+
 static void
 catch_reload_signal (int sig)
 {
-  reload_config ();
+  /* Reloading allocates memory and frees the old configuration, which
+   * isn't safe here, so just wake up the reloader thread.
+   */
+  int saved_errno = errno;
+
+  if (reload_fd[1] >= 0 && write (reload_fd[1], "", 1) == -1)
+    ;				/* Pipe full: a reload is already pending. */
+  errno = saved_errno;
 }
 
 static void
 catch_quit_signal (int sig)
 {
-  /* Exit gracefully (how!?!) XXX */
-  exit (0);
+  /* Saving the manifest isn't safe here either. If the quitter thread
+   * hasn't started, there is nothing to save yet.
+   */
+  int saved_errno = errno;
+
+  if (quit_fd[1] < 0)
+    _exit (0);
+  if (write (quit_fd[1], "", 1) == -1)
+    ;				/* Pipe full: a quit is already pending. */
+  errno = saved_errno;
 }
 
 static void
@@ -251,16 +361,130 @@ catch_child_signal (int sig)
   wait (0);
 }
 
-static void
+/* Read the configuration file, the mime.types file and the rewrite
+ * rules, and start using them if they are all OK. Returns -1 if there
+ * is an error, in which case the old configuration stays in use.
+ */
+static int
 reload_config ()
 {
+  void *gen, *main_cfg, *host;
+  sash mime_map;
+  vector hosts;
+  struct timeval start, end;
+  int i;
+
+  gettimeofday (&start, 0);
+
   /* Reread configuration file. */
-  cfg_reread_config (config_path);
+  gen = cfg_read_config (config_path);
+  if (gen == 0)
+    return -1;
+  main_cfg = cfg_get_main (gen);
 
   /* Read /etc/mime.types file. */
-  mime_types_reread_config (cfg_get_string (0, 0, "mime types file",
-					    "/etc/mime.types"));
+  mime_map = mime_types_read (cfg_get_pool (gen),
+			      cfg_get_string (main_cfg, 0, "mime types file",
+					      "/etc/mime.types"));
+  if (mime_map == 0)
+    goto error;
+
+  /* Check the rewrite rules. */
+  if (rewrite_check_rules (main_cfg) == -1)
+    goto error;
+  hosts = cfg_get_hosts (gen);
+  for (i = 0; i < vector_size (hosts); ++i)
+    {
+      vector_get (hosts, i, host);
+      if (rewrite_check_rules (host) == -1)
+	goto error;
+    }
+
+  /* Everything is OK, so start using it. */
+  cfg_publish (gen);
+  mime_types_set_map (mime_map);
 
   /* Reset rewrite rules. */
   rewrite_reset_rules ();
+
+  /* For the server status page. */
+  gettimeofday (&end, 0);
+  status_counters.config_loads++;
+  status_counters.config_load_usecs =
+    (end.tv_sec - start.tv_sec) * 1000000 + end.tv_usec - start.tv_usec;
+
+  return 0;
+
+ error:
+  cfg_discard (gen);
+  return -1;
+}
+
+/* Make a pipe for a signal handler to wake up a thread. */
+static void
+make_signal_pipe (int fds[2])
+{
+  if (pipe (fds) == -1) { perror ("pipe"); exit (1); }
+  if (fcntl (fds[0], F_SETFD, FD_CLOEXEC) < 0 ||
+      fcntl (fds[1], F_SETFD, FD_CLOEXEC) < 0 ||
+      fcntl (fds[0], F_SETFL, O_NONBLOCK) < 0 ||
+      fcntl (fds[1], F_SETFL, O_NONBLOCK) < 0)
+    { perror ("fcntl"); exit (1); }
+}
+
+static void
+start_reloader ()
+{
+  pseudothread pth;
+
+  make_signal_pipe (reload_fd);
+
+  pth = new_pseudothread (new_subpool (global_pool), reloader, 0,
+			  "reloader");
+  pth_start (pth);
+}
+
+static void
+reloader (void *vp)
+{
+  char buf[64];
+
+  for (;;)
+    {
+      /* Several signals may have arrived, but one reload will do. */
+      if (pth_read (reload_fd[0], buf, sizeof buf) <= 0)
+	{
+	  perror ("read: reload pipe");
+	  pth_exit ();
+	}
+
+      if (reload_config () == -1)
+	fprintf (stderr,
+		 "rws: errors in the new configuration, "
+		 "keeping the old one\n");
+    }
+}
+
+static void
+start_quitter ()
+{
+  pseudothread pth;
+
+  make_signal_pipe (quit_fd);
+
+  pth = new_pseudothread (new_subpool (global_pool), quitter, 0,
+			  "quitter");
+  pth_start (pth);
+}
+
+static void
+quitter (void *vp)
+{
+  char buf[64];
+
+  if (pth_read (quit_fd[0], buf, sizeof buf) <= 0)
+    perror ("read: quit pipe");
+
+  file_save_manifest ();
+  exit (0);
 }
@@ -30,11 +30,10 @@
 #include "re.h"
 #include "mime_types.h"
 
-static pool mt_pool = 0;
 static sash mt_map = 0;
 
-void
-mime_types_reread_config (const char *path)
+sash
+mime_types_read (pool map_pool, const char *path)
 {
   FILE *fp;
   char *line = 0;
@@ -42,17 +41,15 @@ mime_types_reread_config (const char *path)
   vector v;
   int i;
   char *mt, *ext;
-
-  if (mt_pool) delete_pool (mt_pool);
-  mt_pool = new_subpool (global_pool);
-
-  mt_map = new_sash (mt_pool);
-
-  tmp = new_subpool (mt_pool);
+  sash map;
 
   /* Read the /etc/mime.types file. */
   fp = fopen (path, "r");
-  if (fp == 0) { perror (path); exit (1); }
+  if (fp == 0) { perror (path); return 0; }
+
+  map = new_sash (map_pool);
+
+  tmp = new_subpool (map_pool);
 
   while ((line = pgetlinec (tmp, fp, line)) != 0)
     {
@@ -71,7 +68,7 @@ mime_types_reread_config (const char *path)
 	  for (i = 1; i < vector_size (v); ++i)
 	    {
 	      vector_get (v, i, ext);
-	      sash_insert (mt_map, ext, mt);
+	      sash_insert (map, ext, mt);
 	    }
 	  break;
 	}
@@ -80,6 +77,14 @@ mime_types_reread_config (const char *path)
   fclose (fp);
 
   delete_pool (tmp);
+
+  return map;
+}
+
+void
+mime_types_set_map (sash map)
+{
+  mt_map = map;
 }
 
 const char *
@@ -21,7 +21,19 @@
 #ifndef MIME_TYPES_H
 #define MIME_TYPES_H
 
-extern void mime_types_reread_config (const char *file);
+#include <pool.h>
+#include <hash.h>
+
+/* Read the mime.types file PATH into a new map allocated in POOL.
+ * Returns NULL if the file can't be read.
+ */
+extern sash mime_types_read (pool pool, const char *path);
+
+/* Start using MAP. The old map is not freed (it belongs to the pool
+ * it was read into).
+ */
+extern void mime_types_set_map (sash map);
+
 extern const char *mime_types_get_type (const char *ext);
 
 #endif /* MIME_TYPES_H */
@@ -0,0 +1,101 @@
+/* The request path canonicalizer used before canonicalize_path.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#include "config.h"
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <pool.h>
+#include <vector.h>
+#include <pstring.h>
+
+#include <pthr_cgi.h>
+
+#include "old_canonical.h"
+
+const char *
+old_canonicalize (pool pool, const char *path)
+{
+  vector comps;
+  const char *comp, *r;
+  int i, is_dir;
+
+  path = cgi_unescape (pool, path);
+  is_dir = path[strlen (path)-1] == '/';
+
+  comps = pstrcsplit (pool, path, '/');
+  for (i = 0; i < vector_size (comps); ++i)
+    {
+      vector_get (comps, i, comp);
+
+      if (strcmp (comp, "") == 0 || strcmp (comp, ".") == 0)
+	{
+	  vector_erase (comps, i);
+	  i--;
+	}
+      else if (strcmp (comp, "..") == 0)
+	{
+	  if (i > 0)
+	    {
+	      vector_erase_range (comps, i-1, i+1);
+	      i -= 2;
+	    }
+	  else
+	    {
+	      vector_erase (comps, i);
+	      i--;
+	    }
+	}
+    }
+
+  r = psprintf (pool, "/%s", pjoin (pool, comps, "/"));
+  if (strlen (r) > 1 && is_dir)
+    r = psprintf (pool, "%s/", r);
+  return r;
+}
+
+int
+old_canonicalize_depth (pool pool, const char *path)
+{
+  vector comps;
+  const char *comp;
+  int i, depth = 0, max_depth = 0;
+
+  path = cgi_unescape (pool, path);
+
+  comps = pstrcsplit (pool, path, '/');
+  for (i = 0; i < vector_size (comps); ++i)
+    {
+      vector_get (comps, i, comp);
+
+      if (strcmp (comp, "") == 0 || strcmp (comp, ".") == 0)
+	;
+      else if (strcmp (comp, "..") == 0)
+	{
+	  if (depth > 0) depth--;
+	}
+      else if (++depth > max_depth)
+	max_depth = depth;
+    }
+
+  return max_depth;
+}
@@ -0,0 +1,41 @@
+/* The request path canonicalizer used before canonicalize_path.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#ifndef OLD_CANONICAL_H
+#define OLD_CANONICAL_H
+
+#include <pool.h>
+
+/* This is only linked into bench_canonical and test_canonical, which
+ * compare canonicalize_path with it.
+ *
+ * Canonicalize PATH the way process_rq did before canonicalize_path
+ * existed: cgi_unescape, pstrcsplit on '/', remove "", "." and ".."
+ * from the vector, and pjoin. The result is allocated in POOL.
+ */
+extern const char *old_canonicalize (pool, const char *path);
+
+/* Return the largest number of components the path held at any one
+ * time while old_canonicalize was removing "." and "..", which is
+ * when canonicalize_path would have refused it.
+ */
+extern int old_canonicalize_depth (pool, const char *path);
+
+#endif /* OLD_CANONICAL_H */
@@ -57,17 +57,18 @@
 #include "dir.h"
 #include "errors.h"
 #include "rewrite.h"
+#include "canonical.h"
+#include "statcache.h"
+#include "status.h"
+#include "keepalive.h"
+#include "route.h"
 #include "process_rq.h"
 
-/* Maximum number of requests to service in one thread. This just acts
- * as a check on the size of the thread pool, preventing it from growing
- * out of control.
- */
-#define MAX_REQUESTS_IN_THREAD 30
-
 #define PR_DEBUG 0		/* Set this to enable debugging. */
 
 static void run (void *vp);
+static int resolve_route (process_rq p, char *path, int *comps, int nr_comps,
+			  struct route *route, int *cacheable);
 
 process_rq
 new_process_rq (int sock)
@@ -88,6 +89,8 @@ new_process_rq (int sock)
   p->sock = sock;
   p->pth = new_pseudothread (pool, run, p, "process_rq");
 
+  status_counters.connections++;
+
   pth_start (p->pth);
 
   return p;
@@ -99,25 +102,67 @@ static void
 run (void *vp)
 {
   process_rq p = (process_rq) vp;
+  pool conn_pool;
   int close = 0;
-  int request_timeout;
-  vector path_comps, v;
-  int i, is_dir, nr_requests = 1;
+  int request_timeout, max_requests;
+  int comps[MAX_PATH_COMPS];
+  int nr_comps, cacheable, nr_requests = 0;
+  char *path;
   const char *location;
+  struct route route;
 
-  p->pool = pth_get_pool (p->pth);
+  /* The thread pool lasts as long as the connection. Each request gets
+   * its own subpool, P->POOL, which is freed before the next request.
+   */
+  conn_pool = pth_get_pool (p->pth);
+  p->pool = 0;
   p->io = io_fdopen (p->sock);
 
+  /* Responses are flushed explicitly, once there are no more pipelined
+   * requests waiting (see below).
+   */
+  io_setbufmode (p->io, IO_MODE_FULLY_BUFFERED);
+
   request_timeout = cfg_get_int (0, 0, "request timeout", 60);
 
+  /* Maximum number of requests to service on one connection, or 0
+   * for no limit.
+   */
+  max_requests = cfg_get_int (0, 0, "max requests per connection", 0);
+
   /* Sit in a loop reading HTTP requests. */
-  while (!close && nr_requests <= MAX_REQUESTS_IN_THREAD)
+  while (!close)
     {
-      /* Generic name for this thread. */
+      if (max_requests > 0 && nr_requests >= max_requests)
+	{
+	  status_counters.max_requests_closes++;
+	  break;
+	}
+
+      /* Generic name for this thread. Set this before freeing the
+       * previous request, since the old name was allocated there.
+       */
       pth_set_name (THREAD_NAME " (idle)");
 
-      /* Count the number of requests serviced in this thread. */
-      nr_requests++;
+      if (p->pool) delete_pool (p->pool);
+      p->pool = new_subpool (conn_pool);
+
+      /* If the client has pipelined more requests, they are already in
+       * the input buffer, and we can answer them without sending what
+       * we have so far. Otherwise send the responses, and wait for the
+       * next request on this persistent connection.
+       */
+      if (nr_requests > 0)
+	{
+	  if (io_get_inbufcount (p->io) > 0)
+	    status_counters.pipelined_requests++;
+	  else
+	    {
+	      io_fflush (p->io);
+	      if (!keepalive_wait (p))
+		break;
+	    }
+	}
 
       /* Timeout requests. */
       pth_timeout (request_timeout);
@@ -127,9 +172,18 @@ run (void *vp)
       if (p->http_request == 0) /* Normal end of file. */
         break;
 
+      /* Count the number of requests serviced in this thread. */
+      if (nr_requests > 0) status_counters.connection_reuses++;
+      nr_requests++;
+
       /* Reset timeout. */
       pth_timeout (0);
 
+      /* The configuration may be reloaded while this request is
+       * running, so hold on to the current one until it has finished.
+       */
+      pool_register_cleanup_fn (p->pool, cfg_unpin, cfg_pin ());
+
       /* Choose the correct configuration file based on the Host: header. */
       p->host_header = http_request_get_header (p->http_request, "Host");
       if (p->host_header)
@@ -137,13 +191,16 @@ run (void *vp)
       else
 	p->host_header = "default";
 
-      if ((p->host = cfg_get_host (p->host_header)) == 0)
+      if ((p->host = cfg_get_host (p->pool, p->host_header)) == 0)
 	{
 	  fprintf (stderr, "unknown virtual host: %s\n", p->host_header);
 	  close = bad_request_error (p, "unknown virtual host");
 	  continue;
 	}
 
+      status_counters.requests++;
+      status_count_request (p);
+
       /* Get the originally requested path. */
       p->requested_path = http_request_path (p->http_request);
       if (!p->requested_path || p->requested_path[0] != '/')
@@ -152,52 +209,18 @@ run (void *vp)
 	  continue;
 	}
 
-      /* Path may contain % sequences. Unescape them. */
-      p->requested_path = cgi_unescape (p->pool, p->requested_path);
-
-      /* If the path ends in a /, then it's a request for a directory.
-       * Record this fact now, because pstrcsplit will forget about the
-       * trailing slash otherwise.
+      /* Construct the canonical path: unescape % sequences and remove
+       * "", "." and ".." components. The trailing slash of a request
+       * for a directory is kept.
        */
-      is_dir = p->requested_path[strlen (p->requested_path)-1] == '/';
-
-      /* Split up the path into individual components. */
-      path_comps = pstrcsplit (p->pool, p->requested_path, '/');
-
-      /* Remove "", "." and ".." components. */
-      for (i = 0; i < vector_size (path_comps); ++i)
+      path = pstrdup (p->pool, p->requested_path);
+      nr_comps = canonicalize_path (path, 1, comps, MAX_PATH_COMPS);
+      if (nr_comps == -1)
 	{
-	  char *comp;
-
-	  vector_get (path_comps, i, comp);
-
-	  if (strcmp (comp, "") == 0 || strcmp (comp, ".") == 0)
-	    {
-	      vector_erase (path_comps, i);
-	      i--;
-	    }
-	  else if (strcmp (comp, "..") == 0)
-	    {
-	      if (i > 0)
-		{
-		  vector_erase_range (path_comps, i-1, i+1);
-		  i -= 2;
-		}
-	      else
-		{
-		  vector_erase (path_comps, i);
-		  i--;
-		}
-	    }
+	  close = bad_request_error (p, "bad pathname");
+	  continue;
 	}
-
-      /* Construct the canonical path. Add a trailing slash if the
-       * original request was for a directory.
-       */
-      p->canonical_path = psprintf (p->pool, "/%s",
-				    pjoin (p->pool, path_comps, "/"));
-      if (strlen (p->canonical_path) > 1 && is_dir)
-	p->canonical_path = psprintf (p->pool, "%s/", p->canonical_path);
+      p->canonical_path = path;
 
 #if PR_DEBUG
       fprintf (stderr, "canonical path is %s\n", p->canonical_path);
@@ -208,79 +231,58 @@ run (void *vp)
 			      p->host_header,
 			      p->canonical_path));
 
-      /* Apply internal and external rewrite rules. */
-      i = apply_rewrites (p, p->canonical_path, &location);
-      if (i == 1)		/* External rewrite. */
+      /* Is it the server status page? */
+      if (status_is_status_page (p))
 	{
-#if PR_DEBUG
-	  fprintf (stderr, "external rewrite rule to %s\n", location);
-#endif
-	  close = moved_permanently (p, location);
+	  close = status_serve (p);
 	  continue;
 	}
-      else if (i == 2)		/* Internal rewrite. */
-	{
-#if PR_DEBUG
-	  fprintf (stderr, "internal rewrite rule to %s\n", location);
-#endif
 
-	  /* Update the http_request object with the new path. This also
-	   * changes the query string held in this object so that the cgi
-	   * library works correctly.
-	   */
-	  http_request_set_url (p->http_request, location);
-
-	  /* Get the path, minus query string. */
-	  p->rewritten_path = http_request_path (p->http_request);
+      /* Work out which alias and file the path refers to, unless we
+       * have done so before.
+       */
+      if (route_lookup (p->pool, p->host, p->canonical_path, &route))
+	{
+	  status_counters.route_hits++;
 
-	  /* Resplit the path. */
-	  path_comps = pstrcsplit (p->pool, p->rewritten_path, '/');
+	  /* The URL has to be changed again for this request. */
+	  if (route.rewrite == 2)
+	    http_request_set_url (p->http_request, route.location);
 	}
-
-      /* Look for longest matching alias. */
-      for (i = vector_size (path_comps); i >= 0; --i)
+      else
 	{
-	  if (i > 0)
+	  status_counters.route_misses++;
+
+	  if (resolve_route (p, path, comps, nr_comps, &route, &cacheable)
+	      == -1)
 	    {
-	      v = new_subvector (p->pool, path_comps, 0, i);
-	      p->aliasname =
-		psprintf (p->pool, "/%s/", pjoin (p->pool, v, "/"));
+	      close = bad_request_error (p, "bad rewritten pathname");
+	      continue;
 	    }
-	  else
-	    p->aliasname = "/";
-
-#if PR_DEBUG
-	  fprintf (stderr, "try to find alias matching %s\n", p->aliasname);
-#endif
-
-	  if ((p->alias = cfg_get_alias (p->host, p->aliasname)) != 0)
-	    goto found_alias;
+	  if (cacheable)
+	    route_insert (p->host, p->canonical_path, &route);
 	}
 
-#if PR_DEBUG
-      fprintf (stderr, "no matching alias found\n");
-#endif
-
-      /* No alias. */
-      close = file_not_found_error (p);
-      continue;
+      if (route.rewrite == 1)	/* External rewrite. */
+	{
+	  close = moved_permanently (p, route.location);
+	  continue;
+	}
 
-    found_alias:
-      /* Build up the remainder of the path and the file. */
-      v = new_subvector (p->pool, path_comps, i, vector_size (path_comps));
-      p->remainder = pjoin (p->pool, v, "/");
+      p->rewritten_path = route.rewritten_path;
+      p->alias = route.alias;
+      p->aliasname = route.aliasname;
+      p->root = route.root;
+      p->remainder = route.remainder;
+      p->file_path = route.file_path;
 
-      /* Find the root path for this alias. */
-      p->root = cfg_get_string (p->host, p->alias, "path", 0);
-      if (p->root == 0)
+      /* No alias, or the alias has no root path. */
+      if (p->alias == 0 || p->root == 0)
 	{
 	  close = file_not_found_error (p);
 	  continue;
 	}
 
-      /* Construct the file path. */
-      p->file_path = psprintf (p->pool, "%s/%s", p->root, p->remainder);
-
 #if PR_DEBUG
       fprintf (stderr,
 	       "rp = %s, cp = %s, rew = %s, "
@@ -292,7 +294,7 @@ run (void *vp)
 #endif
 
       /* Find the file to serve and stat it. */
-      if (stat (p->file_path, &p->statbuf) == -1)
+      if (statcache_stat (p->file_path, &p->statbuf) == -1)
 	{
 	  close = file_not_found_error (p);
 	  continue;
@@ -330,3 +332,82 @@ run (void *vp)
 
   pth_exit ();
 }
+
+/* Apply the rewrite rules to PATH (the canonical path, split into
+ * NR_COMPS components at the offsets in COMPS), find the matching
+ * alias, and fill in *ROUTE. *CACHEABLE is set to 0 if the result
+ * depends on more than the host and path. Returns -1 if the rewrite
+ * rules loop, or an internal rewrite produced a bad path.
+ */
+static int
+resolve_route (process_rq p, char *path, int *comps, int nr_comps,
+	       struct route *route, int *cacheable)
+{
+  const char *location;
+  int i, len;
+
+  memset (route, 0, sizeof *route);
+
+  /* Apply internal and external rewrite rules. */
+  route->rewrite = apply_rewrites (p, path, &location, cacheable);
+  if (route->rewrite == -1)
+    return -1;
+  else if (route->rewrite == 1)	/* External rewrite. */
+    {
+#if PR_DEBUG
+      fprintf (stderr, "external rewrite rule to %s\n", location);
+#endif
+      route->location = location;
+      return 0;
+    }
+  else if (route->rewrite == 2)	/* Internal rewrite. */
+    {
+#if PR_DEBUG
+      fprintf (stderr, "internal rewrite rule to %s\n", location);
+#endif
+      route->location = location;
+
+      /* Update the http_request object with the new path. This also
+       * changes the query string held in this object so that the cgi
+       * library works correctly.
+       */
+      http_request_set_url (p->http_request, location);
+
+      /* Get the path, minus query string. */
+      route->rewritten_path = http_request_path (p->http_request);
+
+      /* Resplit the path. */
+      if (!route->rewritten_path || route->rewritten_path[0] != '/')
+	return -1;
+      path = pstrdup (p->pool, route->rewritten_path);
+      nr_comps = canonicalize_path (path, 0, comps, MAX_PATH_COMPS);
+      if (nr_comps == -1)
+	return -1;
+    }
+
+  /* Look for longest matching alias. */
+  route->alias = cfg_find_alias (p->host, path, comps, nr_comps, &i,
+				 &route->aliasname, &route->root);
+  if (route->alias == 0)
+    {
+#if PR_DEBUG
+      fprintf (stderr, "no matching alias found\n");
+#endif
+      return 0;
+    }
+
+  /* Build up the remainder of the path and the file. */
+  len = strlen (path);
+  if (len > 1 && path[len-1] == '/') len--;
+  if (i < nr_comps)
+    route->remainder = pstrndup (p->pool, path + comps[i], len - comps[i]);
+  else
+    route->remainder = "";
+
+  /* Construct the file path. */
+  if (route->root)
+    route->file_path = psprintf (p->pool, "%s/%s",
+				 route->root, route->remainder);
+
+  return 0;
+}
@@ -38,6 +38,7 @@
 #include <pthr_pseudothread.h>
 #include <pthr_http.h>
 #include <pthr_iolib.h>
+#include <pthr_wait_queue.h>
 
 /* The PROCESS_RQ type is both the pseudothread object which handles
  * the request, and also the request information structure itself.
@@ -46,7 +47,7 @@
 struct process_rq
 {
   pseudothread pth;		/* Pseudothread handle. */
-  pool pool;			/* Thread pool for all allocations. */
+  pool pool;			/* Pool for the current request. */
   int sock;			/* Socket fd. */
   io_handle io;			/* IO handle. */
   http_request http_request;	/* HTTP request object. */
@@ -109,6 +110,14 @@ struct process_rq
   const char *file_path;
 
   struct stat statbuf;		/* Stat of file. */
+
+  /* Links in the list of idle connections, and the state of an idle
+   * connection (see keepalive.c).
+   */
+  struct process_rq *idle_prev, *idle_next;
+  time_t idle_deadline;		/* When it will be timed out. */
+  wait_queue idle_wq;		/* Where it sleeps while parked. */
+  int idle_result;		/* -1 while parked, then the result. */
 };
 
 typedef struct process_rq *process_rq;
@@ -22,6 +22,9 @@
 
 #include <stdio.h>
 
+#include <stdlib.h>
+#include <ctype.h>
+
 #ifdef HAVE_STRING_H
 #include <string.h>
 #endif
@@ -38,18 +41,38 @@
 #include "process_rq.h"
 #include "re.h"
 #include "rewrite.h"
+#include "route.h"
 
 #define RW_DEBUG 0		/* Set this to enable debugging. */
 
+/* A path is rewritten by at most this many rules which are not 'last',
+ * so that rules which rewrite each other's results can't loop forever.
+ */
+#define RW_MAX_MATCHES 32
+
+/* Study patterns with the JIT compiler, where PCRE has one. */
+#ifdef PCRE_STUDY_JIT_COMPILE
+#define RW_STUDY_OPTIONS PCRE_STUDY_JIT_COMPILE
+#else
+#define RW_STUDY_OPTIONS 0
+#endif
+
 static pool rw_pool = 0;
 
 /* Cache of host -> struct rw *. The null host is stored with key = "". */
 static shash rw_cache;
 
+/* Hosts erased from rw_cache since rw_pool was made. Their rules stay
+ * in rw_pool, so once there are more of them than hosts in the cache,
+ * the cache is started again.
+ */
+static int nr_forgotten = 0;
+
 /* Pre-parsed rules. */
 struct rw
 {
   vector rules;			/* Vector of struct rw_rule. */
+  struct rw_node *index;	/* The rules, by literal prefix. */
 };
 
 /* Each rule. */
@@ -57,6 +80,8 @@ struct rw_rule
 {
   const char *pattern_text;
   const pcre *pattern;
+  const pcre_extra *extra;	/* Result of pcre_study, may be NULL. */
+  const char *prefix;		/* Every matching path starts with this. */
   const char *sub;
   int flags;
 #define RW_RULE_EXTERNAL 0x0001
@@ -64,24 +89,61 @@ struct rw_rule
 #define RW_RULE_QSA      0x0004
 };
 
-static struct rw *parse_rules (const char *cfg);
+/* A trie of the literal prefixes of the rules. A rule is stored in the
+ * node for its prefix, so the rules which can match a path are those
+ * in the nodes along the path from the root (which has the rules with
+ * no prefix).
+ */
+struct rw_node
+{
+  vector rules;			/* Vector of int (index into rules). */
+  vector children;		/* Vector of struct rw_child. */
+};
+
+struct rw_child
+{
+  char c;
+  struct rw_node *node;
+};
+
+static struct rw *parse_rules (pool rules_pool, const char *cfg, int *errors);
+static const char *literal_prefix (pool rules_pool, const char *pattern);
+static struct rw_node *new_rw_node (pool rules_pool);
+static void index_rule (pool rules_pool, struct rw *rw, int i);
+static int find_candidates (const struct rw *rw, const char *path, int *cands);
+static int compare_ints (const int *i1, const int *i2);
+static void free_study (void *extra);
 static const char *append_qs (process_rq p, const char *path);
 
-void
-rewrite_reset_rules ()
+static void
+new_rw_cache (void)
 {
   if (rw_pool) delete_pool (rw_pool);
   rw_pool = new_subpool (global_pool);
 
   rw_cache = new_shash (rw_pool, struct rw *);
+  nr_forgotten = 0;
+}
+
+void
+rewrite_reset_rules ()
+{
+  new_rw_cache ();
+
+  /* Routes which were resolved with the old rules are now wrong. */
+  route_flush ();
 }
 
 int
-apply_rewrites (const process_rq p, const char *path, const char **location)
+apply_rewrites (const process_rq p, const char *path, const char **location,
+		int *cacheable)
 {
   struct rw *rw = 0;
   const char *host = p->host_header ? p->host_header : "";
-  int i, matches = 0, qsa = 0;
+  int i, matches = 0, qsa = 0, errors = 0, nr_cands;
+  int *cands;
+
+  *cacheable = 1;
 
 #if RW_DEBUG
   fprintf (stderr, "apply_rewrites: original path = %s\n",
@@ -96,7 +158,7 @@ apply_rewrites (const process_rq p, const char *path, const char **location)
       const char *cfg;
 
       cfg = cfg_get_string (p->host, 0, "rewrite", 0);
-      if (cfg) rw = parse_rules (cfg);
+      if (cfg) rw = parse_rules (rw_pool, cfg, &errors);
       shash_insert (rw_cache, host, rw);
     }
 
@@ -108,24 +170,44 @@ apply_rewrites (const process_rq p, const char *path, const char **location)
       return 0;
     }
 
-  /* Look for a matching rule. */
-  for (i = 0; i < vector_size (rw->rules); ++i)
+  /* Look for a matching rule, among those whose prefix matches. */
+  cands = pmalloc (p->pool, vector_size (rw->rules) * sizeof (int));
+  nr_cands = find_candidates (rw, path, cands);
+
+  for (i = 0; i < nr_cands; ++i)
     {
       struct rw_rule rule;
       const char *old_path = path;
 
-      vector_get (rw->rules, i, rule);
+      vector_get (rw->rules, cands[i], rule);
 
 #if RW_DEBUG
       fprintf (stderr, "apply_rewrites: try matching against %s\n",
 	       rule.pattern_text);
 #endif
 
+      /* Most rules don't match, and this is quicker at finding out than
+       * presubst.
+       */
+      if (pcre_exec (rule.pattern, rule.extra, old_path, strlen (old_path),
+		     0, 0, 0, 0) < 0)
+	continue;
+
       path = presubst (p->pool, old_path, rule.pattern, rule.sub, 0);
       if (path != old_path) /* It matched. */
 	{
-	  matches = 1;
-	  if (rule.flags & RW_RULE_QSA) qsa = 1;
+	  if (++matches > RW_MAX_MATCHES)
+	    {
+	      fprintf (stderr,
+		       "rewrite rules loop for http://%s%s\n",
+		       host, p->canonical_path);
+	      return -1;
+	    }
+	  if (rule.flags & RW_RULE_QSA)
+	    {
+	      qsa = 1;
+	      *cacheable = 0;
+	    }
 
 #if RW_DEBUG
 	  fprintf (stderr, "apply_rewrites: it matches %s\n",
@@ -159,6 +241,7 @@ apply_rewrites (const process_rq p, const char *path, const char **location)
 	    }
 
 	  /* Jump back to the beginning of the list. */
+	  nr_cands = find_candidates (rw, path, cands);
 	  i = -1;
 	}
     }
@@ -202,17 +285,47 @@ append_qs (process_rq p, const char *path)
   return path;			/* No query string. */
 }
 
+void
+rewrite_forget_host (const char *host)
+{
+  if (rw_pool && shash_erase (rw_cache, host) &&
+      ++nr_forgotten > shash_size (rw_cache))
+    new_rw_cache ();
+}
+
+int
+rewrite_check_rules (void *host_ptr)
+{
+  pool tmp;
+  const char *cfg;
+  int errors = 0;
+
+  cfg = cfg_get_string (host_ptr, 0, "rewrite", 0);
+  if (!cfg) return 0;
+
+  tmp = new_subpool (global_pool);
+  parse_rules (tmp, cfg, &errors);
+  delete_pool (tmp);
+
+  return errors ? -1 : 0;
+}
+
 static void parse_error (const char *line, const char *msg);
 
+/* Parse the rules in CFG, allocating them in RULES_POOL. Bad rules are
+ * reported, counted in *ERRORS, and left out.
+ */
 static struct rw *
-parse_rules (const char *cfg)
+parse_rules (pool rules_pool, const char *cfg, int *errors)
 {
-  pool tmp = new_subpool (rw_pool);
+  pool tmp = new_subpool (rules_pool);
   vector lines;
   const char *line;
   struct rw *rw;
   struct rw_rule rule;
-  int i;
+  pcre *re;
+  const char *re_err;
+  int i, re_erroffset;
 
   /* Split up the configuration string into lines. */
   lines = pstrcsplit (tmp, cfg, '\n');
@@ -234,8 +347,9 @@ parse_rules (const char *cfg)
   if (vector_size (lines) == 0) { delete_pool (tmp); return 0; }
 
   /* Allocate space for the return structure. */
-  rw = pmalloc (rw_pool, sizeof *rw);
-  rw->rules = new_vector (rw_pool, struct rw_rule);
+  rw = pmalloc (rules_pool, sizeof *rw);
+  rw->rules = new_vector (rules_pool, struct rw_rule);
+  rw->index = new_rw_node (rules_pool);
 
   /* Each line is a separate rule in the current syntax, so examine
    * each line and turn it into a rule.
@@ -249,12 +363,34 @@ parse_rules (const char *cfg)
       v = pstrresplit (tmp, line, re_ws);
 
       if (vector_size (v) < 2 || vector_size (v) > 3)
-	parse_error (line, "unrecognised format");
+	{
+	  parse_error (line, "unrecognised format");
+	  (*errors)++;
+	  continue;
+	}
       vector_get (v, 0, rule.pattern_text);
-      rule.pattern_text = pstrdup (rw_pool, rule.pattern_text);
-      rule.pattern = precomp (rw_pool, rule.pattern_text, 0);
+
+      /* Check the regular expression first, since precomp aborts if it
+       * is bad.
+       */
+      re = pcre_compile (rule.pattern_text, 0, &re_err, &re_erroffset, 0);
+      if (re == 0)
+	{
+	  parse_error (line, re_err);
+	  (*errors)++;
+	  continue;
+	}
+      pcre_free (re);
+
+      rule.pattern_text = pstrdup (rules_pool, rule.pattern_text);
+      rule.pattern = precomp (rules_pool, rule.pattern_text, 0);
+      rule.prefix = literal_prefix (rules_pool, rule.pattern_text);
+      rule.extra = pcre_study (rule.pattern, RW_STUDY_OPTIONS, &re_err);
+      if (rule.extra)
+	pool_register_cleanup_fn (rules_pool, free_study,
+				  (void *) rule.extra);
       vector_get (v, 1, rule.sub);
-      rule.sub = pstrdup (rw_pool, rule.sub);
+      rule.sub = pstrdup (rules_pool, rule.sub);
 
       /* Parse the flags. */
       rule.flags = 0;
@@ -279,7 +415,10 @@ parse_rules (const char *cfg)
 	      else if (strcasecmp (flag, "qsa") == 0)
 		rule.flags |= RW_RULE_QSA;
 	      else
-		parse_error (line, "unknown flag");
+		{
+		  parse_error (line, "unknown flag");
+		  (*errors)++;
+		}
 	    }
 	}
 
@@ -290,12 +429,145 @@ parse_rules (const char *cfg)
 #endif
 
       vector_push_back (rw->rules, rule);
+      index_rule (rules_pool, rw, vector_size (rw->rules) - 1);
     }
 
   delete_pool (tmp);
   return rw;
 }
 
+/* Return the literal text at the start of every string which PATTERN
+ * matches, or "" if it can't be worked out (for instance, if PATTERN
+ * isn't anchored). This only has to be right, not as long as possible.
+ */
+static const char *
+literal_prefix (pool rules_pool, const char *pattern)
+{
+  char *prefix, *q, *last;
+  const char *s;
+
+  if (pattern[0] != '^' || strchr (pattern, '|')) return "";
+
+  prefix = q = pmalloc (rules_pool, strlen (pattern));
+  for (s = pattern + 1; *s; )
+    {
+      last = q;
+      if (*s == '\\' && s[1] && !isalnum ((unsigned char) s[1]))
+	{
+	  *q++ = s[1];		/* Escaped punctuation, eg. "\." */
+	  s += 2;
+	}
+      else if (*s == '\\' || strchr (".[](){}*+?^$", *s))
+	break;
+      else
+	*q++ = *s++;
+
+      /* A character followed by one of these may be left out. */
+      if (*s == '*' || *s == '?' || *s == '{')
+	{
+	  q = last;
+	  break;
+	}
+    }
+  *q = '\0';
+
+  return prefix;
+}
+
+static struct rw_node *
+new_rw_node (pool rules_pool)
+{
+  struct rw_node *node = pmalloc (rules_pool, sizeof *node);
+
+  node->rules = new_vector (rules_pool, int);
+  node->children = new_vector (rules_pool, struct rw_child);
+  return node;
+}
+
+/* Add rule I to the prefix index. */
+static void
+index_rule (pool rules_pool, struct rw *rw, int i)
+{
+  struct rw_rule *rule;
+  struct rw_node *node = rw->index;
+  struct rw_child child;
+  const char *s;
+  int j;
+
+  vector_get_ptr (rw->rules, i, rule);
+
+  for (s = rule->prefix; *s; ++s)
+    {
+      for (j = 0; j < vector_size (node->children); ++j)
+	{
+	  vector_get (node->children, j, child);
+	  if (child.c == *s) break;
+	}
+      if (j == vector_size (node->children))
+	{
+	  child.c = *s;
+	  child.node = new_rw_node (rules_pool);
+	  vector_push_back (node->children, child);
+	}
+      node = child.node;
+    }
+
+  vector_push_back (node->rules, i);
+}
+
+/* Put the numbers of the rules which might match PATH into CANDS, in
+ * the order they appear in the configuration file, and return how
+ * many there are.
+ */
+static int
+find_candidates (const struct rw *rw, const char *path, int *cands)
+{
+  const struct rw_node *node = rw->index;
+  struct rw_child child;
+  int i, n = 0, sorted = 1;
+
+  for (;;)
+    {
+      for (i = 0; i < vector_size (node->rules); ++i)
+	{
+	  vector_get (node->rules, i, cands[n]);
+	  if (n > 0 && cands[n] < cands[n-1]) sorted = 0;
+	  n++;
+	}
+
+      if (!*path) break;
+      for (i = 0; i < vector_size (node->children); ++i)
+	{
+	  vector_get (node->children, i, child);
+	  if (child.c == *path) break;
+	}
+      if (i == vector_size (node->children)) break;
+      node = child.node;
+      path++;
+    }
+
+  if (!sorted)
+    qsort (cands, n, sizeof (int),
+	   (int (*) (const void *, const void *)) compare_ints);
+  return n;
+}
+
+static int
+compare_ints (const int *i1, const int *i2)
+{
+  return *i1 - *i2;
+}
+
+static void
+free_study (void *extra)
+{
+#ifdef PCRE_STUDY_JIT_COMPILE
+  pcre_free_study ((pcre_extra *) extra);
+#else
+  pcre_free (extra);
+#endif
+}
+
 static void
 parse_error (const char *line, const char *msg)
 {
@@ -303,5 +575,4 @@ parse_error (const char *line, const char *msg)
 	   "rewrite rule: %s\n"
 	   "at line: %s\n",
 	   msg, line);
-  exit (1);
 }
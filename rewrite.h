@@ -28,13 +28,30 @@
 /* Reset the rewrite rules. */
 extern void rewrite_reset_rules (void);
 
+/* Forget the rules of virtual host HOST (a Host: header), which are
+ * cached after they are first used.
+ */
+extern void rewrite_forget_host (const char *host);
+
+/* Check the rewrite rules of HOST_PTR (see cfg_get_main and
+ * cfg_get_hosts). Errors are printed, and the function returns -1 if
+ * there were any, else 0.
+ */
+extern int rewrite_check_rules (void *host_ptr);
+
 /* This function applies internal and external rewrite rules found
  * in the configuration file. If there is no rewrite, *location is
  * left alone and the function returns 0. If there is an external
  * rewrite, *location points to the rewritten path and the function
  * returns 1. Internal rewrites are the same as external rewrites
- * except the function returns 2.
+ * except the function returns 2. If the rules keep rewriting the path
+ * (in a loop, for instance), a message is printed and the function
+ * returns -1.
+ *
+ * *CACHEABLE is set to 0 if the result depends on anything other than
+ * the host and PATH (ie. the query string was appended), else 1.
  */
-extern int apply_rewrites (const process_rq p, const char *path, const char **location);
+extern int apply_rewrites (const process_rq p, const char *path,
+			   const char **location, int *cacheable);
 
 #endif /* REWRITE_H */
@@ -0,0 +1,150 @@
+/* Cache of resolved routes.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+
+#include <pool.h>
+#include <hash.h>
+#include <pstring.h>
+
+#include "cfg.h"
+#include "route.h"
+
+static int max_entries = 1000;
+
+/* Routes inserted since the table was made. Routes which have since
+ * been replaced or forgotten are counted too, because their strings
+ * stay in the table's pool until it is flushed.
+ */
+static int nr_inserts = 0;
+
+/* All the routes live in the pool of a route table, which is replaced
+ * when the cache is flushed or full (as in statcache.c). A request
+ * which has looked up a route holds a reference to the table, so the
+ * strings in the route stay valid until the request has finished, and
+ * an old table is freed when the last such request has.
+ */
+struct route_table
+{
+  pool pool;
+  int refs;			/* Number of requests using it. */
+  hash routes;			/* Hash of host -> shash of path -> route. */
+};
+
+static struct route_table *table = 0;
+
+static void put_table (void *t);
+
+static void
+copy_strings (pool pool, struct route *r)
+{
+  if (r->location) r->location = pstrdup (pool, r->location);
+  if (r->rewritten_path)
+    r->rewritten_path = pstrdup (pool, r->rewritten_path);
+  if (r->aliasname) r->aliasname = pstrdup (pool, r->aliasname);
+  if (r->root) r->root = pstrdup (pool, r->root);
+  if (r->remainder) r->remainder = pstrdup (pool, r->remainder);
+  if (r->file_path) r->file_path = pstrdup (pool, r->file_path);
+}
+
+int
+route_lookup (pool pool, void *host_ptr, const char *path,
+	      struct route *route)
+{
+  shash h;
+  const struct route *r;
+
+  if (!table || !hash_get (table->routes, host_ptr, h))
+    return 0;
+
+  shash_get_ptr (h, path, r);
+  if (!r)
+    return 0;
+
+  *route = *r;
+
+  table->refs++;
+  pool_register_cleanup_fn (pool, put_table, table);
+  return 1;
+}
+
+static void
+put_table (void *t)
+{
+  struct route_table *old = (struct route_table *) t;
+
+  if (--old->refs == 0 && old != table)
+    delete_pool (old->pool);
+}
+
+void
+route_insert (void *host_ptr, const char *path, const struct route *route)
+{
+  struct route r;
+  shash h;
+
+  if (max_entries <= 0) return;
+
+  if (!table || nr_inserts >= max_entries)
+    route_flush ();
+
+  if (!hash_get (table->routes, host_ptr, h))
+    {
+      h = new_shash (table->pool, struct route);
+      hash_insert (table->routes, host_ptr, h);
+    }
+
+  r = *route;
+  copy_strings (table->pool, &r);
+
+  shash_insert (h, path, r);
+  nr_inserts++;
+}
+
+void
+route_forget_host (void *host_ptr)
+{
+  shash h;
+
+  if (table && hash_get (table->routes, host_ptr, h))
+    hash_erase (table->routes, host_ptr);
+}
+
+void
+route_flush ()
+{
+  struct route_table *old = table;
+  pool pool;
+
+  pool = new_subpool (global_pool);
+  table = pmalloc (pool, sizeof *table);
+  table->pool = pool;
+  table->refs = 0;
+  table->routes = new_hash (pool, void *, shash);
+  nr_inserts = 0;
+
+  /* Requests still using the old table free it when they finish. */
+  if (old && old->refs == 0)
+    delete_pool (old->pool);
+
+  max_entries = cfg_get_int (0, 0, "route cache entries", 1000);
+}
@@ -0,0 +1,63 @@
+/* Cache of resolved routes.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#ifndef ROUTE_H
+#define ROUTE_H
+
+#include <pool.h>
+
+/* How a request path on a particular host was resolved: the result of
+ * the rewrite rules, the matching alias, and the file it refers to.
+ */
+struct route
+{
+  int rewrite;			/* Result of apply_rewrites. */
+  const char *location;		/* Rewritten URL (if REWRITE != 0). */
+  const char *rewritten_path;	/* Path after an internal rewrite. */
+  void *alias;			/* Matching alias, or NULL if none. */
+  const char *aliasname;
+  const char *root;
+  const char *remainder;
+  const char *file_path;
+};
+
+/* Look up PATH, a canonical path, for host HOST_PTR. If it is cached,
+ * copy the route into *ROUTE and return 1. The strings in *ROUTE belong
+ * to the cache, which keeps them until POOL is deleted even if the
+ * cache is flushed meanwhile. Otherwise return 0.
+ */
+extern int route_lookup (pool pool, void *host_ptr, const char *path,
+			 struct route *route);
+
+/* Remember how PATH was resolved for host HOST_PTR. The cache holds at
+ * most 'route cache entries' routes.
+ */
+extern void route_insert (void *host_ptr, const char *path,
+			  const struct route *route);
+
+/* Forget the routes of host HOST_PTR. */
+extern void route_forget_host (void *host_ptr);
+
+/* Forget every route. This is called whenever the configuration file
+ * or the rewrite rules are reloaded.
+ */
+extern void route_flush (void);
+
+#endif /* ROUTE_H */
@@ -0,0 +1,145 @@
+/* Stat cache.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <errno.h>
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+
+#include <pool.h>
+#include <hash.h>
+
+#include "cfg.h"
+#include "statcache.h"
+#include "timecache.h"
+
+/* A cached result of stat(2). If ERR is non-zero then the call failed
+ * with that errno (a negative entry) and STATBUF is not used.
+ */
+struct stat_entry
+{
+  time_t expires;
+  int err;
+  struct stat statbuf;
+};
+
+static int ttl = 1;
+static int max_entries = 1000;
+
+/* All the entries live in their own pool. When the cache is full we
+ * just throw the whole lot away and start again, which is cheaper than
+ * keeping track of which entries are oldest.
+ */
+static pool stat_pool = 0;
+static shash stat_hash;
+
+/* Paths added to stat_hash since it was made, including those removed
+ * by statcache_invalidate, since their keys stay in stat_pool.
+ */
+static int nr_inserts = 0;
+
+static void
+new_cache (void)
+{
+  stat_pool = new_subpool (global_pool);
+  stat_hash = new_shash (stat_pool, struct stat_entry);
+  nr_inserts = 0;
+}
+
+void
+statcache_init ()
+{
+  ttl = cfg_get_int (0, 0, "stat cache ttl", 1);
+  max_entries = cfg_get_int (0, 0, "stat cache entries", 1000);
+
+  new_cache ();
+}
+
+int
+statcache_stat (const char *path, struct stat *statbuf)
+{
+  const struct stat_entry *entry;
+  struct stat_entry new_entry;
+  time_t now;
+
+  if (ttl <= 0)
+    return stat (path, statbuf);
+
+  now = timecache_now ();
+
+  shash_get_ptr (stat_hash, path, entry);
+  if (entry && entry->expires > now)
+    {
+      if (entry->err)
+	{
+	  errno = entry->err;
+	  return -1;
+	}
+      *statbuf = entry->statbuf;
+      return 0;
+    }
+
+  /* Cache miss, or the entry has expired. */
+  new_entry.expires = now + ttl;
+  new_entry.err = 0;
+  if (stat (path, &new_entry.statbuf) == -1)
+    new_entry.err = errno;
+
+  if (!entry)
+    {
+      if (nr_inserts >= max_entries)
+	statcache_flush ();
+      nr_inserts++;
+    }
+  shash_insert (stat_hash, path, new_entry);
+
+  if (new_entry.err)
+    {
+      errno = new_entry.err;
+      return -1;
+    }
+  *statbuf = new_entry.statbuf;
+  return 0;
+}
+
+void
+statcache_invalidate (const char *path)
+{
+  shash_erase (stat_hash, path);
+}
+
+void
+statcache_flush ()
+{
+  delete_pool (stat_pool);
+  new_cache ();
+}
@@ -0,0 +1,46 @@
+/* Stat cache.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#ifndef STATCACHE_H
+#define STATCACHE_H
+
+#include "config.h"
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+extern void statcache_init (void);
+
+/* This behaves like stat(2): it returns 0 and fills in *STATBUF, or
+ * returns -1 and sets errno. Results (including failures) are cached
+ * for 'stat cache ttl' seconds.
+ */
+extern int statcache_stat (const char *path, struct stat *statbuf);
+
+/* Forget about PATH, or about every path. */
+extern void statcache_invalidate (const char *path);
+extern void statcache_flush (void);
+
+#endif /* STATCACHE_H */
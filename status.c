@@ -0,0 +1,317 @@
+/* Server statistics.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+
+#include <pool.h>
+#include <vector.h>
+#include <hash.h>
+#include <pstring.h>
+
+#include <pthr_pseudothread.h>
+#include <pthr_http.h>
+#include <pthr_iolib.h>
+
+#include "process_rq.h"
+#include "cfg.h"
+#include "file.h"
+#include "status.h"
+
+struct status_counters status_counters;
+
+static time_t start_time;
+
+/* Maps virtual host names to the number of requests for them. */
+static shash host_requests;
+
+static cfg_key_t server_status_key;
+
+static int compare_strings (const char **s1, const char **s2);
+static void text_status (process_rq p);
+static void json_status (process_rq p);
+static const char *json_string (pool pool, const char *str);
+
+void
+status_init ()
+{
+  time (&start_time);
+  host_requests = new_shash (global_pool, unsigned long);
+  server_status_key = cfg_intern ("server status");
+}
+
+void
+status_count_request (process_rq p)
+{
+  unsigned long *n, one = 1;
+
+  shash_get_ptr (host_requests, p->host_header, n);
+  if (n)
+    (*n)++;
+  else
+    shash_insert (host_requests, p->host_header, one);
+}
+
+int
+status_is_status_page (process_rq p)
+{
+  const char *path = cfg_get_string_key (p->host, 0, server_status_key, 0);
+
+  return path && strcmp (path, p->canonical_path) == 0;
+}
+
+int
+status_serve (process_rq p)
+{
+  http_response http_response;
+  const char *qs;
+  int close, json;
+
+  qs = http_request_query_string (p->http_request);
+  json = qs && strcmp (qs, "json") == 0;
+
+  http_response = new_http_response (p->pool, p->http_request, p->io,
+				     200, "OK");
+  http_response_send_headers (http_response,
+			      /* Content type. */
+			      "Content-Type",
+			      json ? "application/json" : "text/plain",
+			      NO_CACHE_HEADERS,
+			      /* End of headers. */
+			      NULL);
+  close = http_response_end_headers (http_response);
+
+  if (http_request_is_HEAD (p->http_request)) return close;
+
+  if (json)
+    json_status (p);
+  else
+    text_status (p);
+
+  return close;
+}
+
+static void
+text_status (process_rq p)
+{
+  struct file_stats fs;
+  vector v;
+  pseudothread pth;
+  const char *host;
+  unsigned long n;
+  int i;
+
+  file_get_stats (&fs);
+
+  io_fprintf (p->io,
+	      "%s" CRLF
+	      "uptime: %ld" CRLF
+	      "requests: %lu" CRLF
+	      CRLF
+	      "connections: %lu" CRLF
+	      "connection reuses: %lu" CRLF
+	      "pipelined requests: %lu" CRLF
+	      "idle timeouts: %lu" CRLF
+	      "idle connections closed: %lu" CRLF
+	      "max requests closes: %lu" CRLF
+	      CRLF
+	      "file cache entries: %d / %d" CRLF
+	      "file cache bytes: %llu / %llu" CRLF
+	      "file cache hits: %lu" CRLF
+	      "file cache misses: %lu" CRLF
+	      "file cache evictions: %lu" CRLF
+	      "file cache invalidations: %lu" CRLF
+	      "route cache hits: %lu" CRLF
+	      "route cache misses: %lu" CRLF
+	      CRLF
+	      "directory listings: %lu" CRLF
+	      "cgi scripts: %lu" CRLF
+	      "shared object scripts: %lu" CRLF
+	      CRLF
+	      "configuration loads: %lu" CRLF
+	      "last configuration load: %lu us" CRLF
+	      CRLF
+	      "requests by host:" CRLF,
+	      http_get_servername (),
+	      (long) (time (0) - start_time),
+	      status_counters.requests,
+	      status_counters.connections,
+	      status_counters.connection_reuses,
+	      status_counters.pipelined_requests,
+	      status_counters.idle_timeouts,
+	      status_counters.idle_closes,
+	      status_counters.max_requests_closes,
+	      fs.nr_entries, fs.max_entries,
+	      (unsigned long long) fs.total_size,
+	      (unsigned long long) fs.max_size,
+	      status_counters.cache_hits,
+	      status_counters.cache_misses,
+	      status_counters.cache_evictions,
+	      status_counters.cache_invalidations,
+	      status_counters.route_hits,
+	      status_counters.route_misses,
+	      status_counters.dir_listings,
+	      status_counters.cgi_scripts,
+	      status_counters.so_scripts,
+	      status_counters.config_loads,
+	      status_counters.config_load_usecs);
+
+  v = shash_keys (host_requests);
+  psort (v, compare_strings);
+  for (i = 0; i < vector_size (v); ++i)
+    {
+      vector_get (v, i, host);
+      shash_get (host_requests, host, n);
+      io_fprintf (p->io, "  %s: %lu" CRLF, host, n);
+    }
+
+  v = pseudothread_get_threads (p->pool);
+  io_fprintf (p->io, CRLF "threads: %d" CRLF, vector_size (v));
+  for (i = 0; i < vector_size (v); ++i)
+    {
+      vector_get (v, i, pth);
+      if (pth)
+	io_fprintf (p->io, "  %d: %s" CRLF,
+		    pth_get_thread_num (pth), pth_get_name (pth));
+    }
+}
+
+static void
+json_status (process_rq p)
+{
+  struct file_stats fs;
+  vector v;
+  pseudothread pth;
+  const char *host;
+  unsigned long n;
+  int i, first;
+
+  file_get_stats (&fs);
+
+  io_fprintf (p->io,
+	      "{\"server\":%s,"
+	      "\"uptime\":%ld,"
+	      "\"requests\":%lu,"
+	      "\"connections\":{"
+	      "\"total\":%lu,\"reuses\":%lu,\"pipelined\":%lu,"
+	      "\"idle_timeouts\":%lu,\"idle_closes\":%lu,"
+	      "\"max_requests_closes\":%lu},"
+	      "\"file_cache\":{"
+	      "\"entries\":%d,\"max_entries\":%d,"
+	      "\"bytes\":%llu,\"max_bytes\":%llu,"
+	      "\"hits\":%lu,\"misses\":%lu,"
+	      "\"evictions\":%lu,\"invalidations\":%lu},"
+	      "\"route_cache\":{\"hits\":%lu,\"misses\":%lu},"
+	      "\"dir_listings\":%lu,"
+	      "\"cgi_scripts\":%lu,"
+	      "\"so_scripts\":%lu,"
+	      "\"config\":{\"loads\":%lu,\"last_load_us\":%lu},"
+	      "\"hosts\":{",
+	      json_string (p->pool, http_get_servername ()),
+	      (long) (time (0) - start_time),
+	      status_counters.requests,
+	      status_counters.connections,
+	      status_counters.connection_reuses,
+	      status_counters.pipelined_requests,
+	      status_counters.idle_timeouts,
+	      status_counters.idle_closes,
+	      status_counters.max_requests_closes,
+	      fs.nr_entries, fs.max_entries,
+	      (unsigned long long) fs.total_size,
+	      (unsigned long long) fs.max_size,
+	      status_counters.cache_hits,
+	      status_counters.cache_misses,
+	      status_counters.cache_evictions,
+	      status_counters.cache_invalidations,
+	      status_counters.route_hits,
+	      status_counters.route_misses,
+	      status_counters.dir_listings,
+	      status_counters.cgi_scripts,
+	      status_counters.so_scripts,
+	      status_counters.config_loads,
+	      status_counters.config_load_usecs);
+
+  v = shash_keys (host_requests);
+  psort (v, compare_strings);
+  for (i = 0; i < vector_size (v); ++i)
+    {
+      vector_get (v, i, host);
+      shash_get (host_requests, host, n);
+      io_fprintf (p->io, "%s%s:%lu",
+		  i > 0 ? "," : "", json_string (p->pool, host), n);
+    }
+
+  io_fputs ("},\"threads\":[", p->io);
+  v = pseudothread_get_threads (p->pool);
+  for (i = 0, first = 1; i < vector_size (v); ++i)
+    {
+      vector_get (v, i, pth);
+      if (pth)
+	{
+	  io_fprintf (p->io, "%s{\"num\":%d,\"name\":%s}",
+		      first ? "" : ",",
+		      pth_get_thread_num (pth),
+		      json_string (p->pool, pth_get_name (pth)));
+	  first = 0;
+	}
+    }
+  io_fputs ("]}" CRLF, p->io);
+}
+
+static int
+compare_strings (const char **s1, const char **s2)
+{
+  return strcmp (*s1, *s2);
+}
+
+/* Quote STR as a JSON string. */
+static const char *
+json_string (pool pool, const char *str)
+{
+  char *r, *s;
+
+  r = s = pmalloc (pool, strlen (str) * 6 + 3);
+  *s++ = '"';
+  for (; *str; ++str)
+    {
+      if (*str == '"' || *str == '\\')
+	{
+	  *s++ = '\\';
+	  *s++ = *str;
+	}
+      else if ((unsigned char) *str < 0x20)
+	s += sprintf (s, "\\u%04x", (unsigned char) *str);
+      else
+	*s++ = *str;
+    }
+  *s++ = '"';
+  *s = '\0';
+
+  return r;
+}
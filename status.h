@@ -0,0 +1,77 @@
+/* Server statistics.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#ifndef STATUS_H
+#define STATUS_H
+
+#include "config.h"
+
+#include "process_rq.h"
+
+/* Counters which are bumped as requests are served, and as the
+ * configuration is loaded. They are only ever read by status_serve.
+ */
+struct status_counters
+{
+  unsigned long requests;	/* All requests. */
+  unsigned long connections;	/* All connections. */
+  unsigned long connection_reuses; /* Requests after the first on
+				    * a connection. */
+  unsigned long pipelined_requests; /* Requests which were already
+				    * buffered when the previous
+				    * response was finished. */
+  unsigned long idle_timeouts;	/* Idle connections timed out. */
+  unsigned long idle_closes;	/* Idle connections closed because
+				 * there were too many. */
+  unsigned long max_requests_closes; /* Connections closed after 'max
+				      * requests per connection'. */
+  unsigned long cache_hits;	/* Files served from the file cache. */
+  unsigned long cache_misses;	/* Files not found in the file cache. */
+  unsigned long cache_evictions; /* Entries dropped to make room. */
+  unsigned long cache_invalidations; /* Entries dropped because the
+				      * file changed. */
+  unsigned long route_hits;	/* Paths found in the route cache. */
+  unsigned long route_misses;	/* Paths which had to be resolved. */
+  unsigned long dir_listings;	/* Directory listings generated. */
+  unsigned long cgi_scripts;	/* CGI scripts run. */
+  unsigned long so_scripts;	/* Shared object scripts run. */
+  unsigned long config_loads;	/* Configurations loaded, at startup
+				 * and on SIGHUP. */
+  unsigned long config_load_usecs; /* Time taken by the last one. */
+};
+
+extern struct status_counters status_counters;
+
+extern void status_init (void);
+
+/* Count a request for the virtual host of P. */
+extern void status_count_request (process_rq p);
+
+/* Is this a request for the status page of the virtual host? If
+ * 'server status' is set for the host, the page is served at that path.
+ */
+extern int status_is_status_page (process_rq p);
+
+/* Send the status page, as plain text, or as JSON if the query string
+ * is "json".
+ */
+extern int status_serve (process_rq p);
+
+#endif /* STATUS_H */
@@ -0,0 +1,203 @@
+/* Checks that canonicalize_path gives the same results as before.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <pool.h>
+#include <vector.h>
+#include <pstring.h>
+
+#include "canonical.h"
+#include "old_canonical.h"
+
+/* Run with 'make test'. Each path is canonicalized by both
+ * canonicalize_path and old_canonicalize, and the results must be
+ * identical. canonicalize_path may refuse a path only if it had more
+ * than MAX_PATH_COMPS components at some point, and then it must.
+ */
+
+static const char *paths[] = {
+  /* Ordinary paths. */
+  "/",
+  "/index.html",
+  "/icons/text.gif",
+  "/docs/",
+  "/docs/manual/chapter01/section%202.html",
+  "/so-bin/show_params.so",
+  "/%7Erich/pub/",
+  "/...",
+  "/a/.../b",
+  "/.a/..b/c.",
+
+  /* Repeated '/'. */
+  "//",
+  "///",
+  "//index.html",
+  "/a//b",
+  "/a/b//",
+  "/a///b///",
+
+  /* "." and "..", including trailing ones and ones above the root. */
+  "/.",
+  "/./",
+  "/..",
+  "/../",
+  "/a/.",
+  "/a/./",
+  "/a/..",
+  "/a/../",
+  "/a/b/.",
+  "/a/b/..",
+  "/a/./b/../c//d/",
+  "/../a",
+  "/../../../etc/passwd",
+  "/a/../../b",
+  "/a/b/../../../c/",
+  "/%7Erich/pub/../notes/",
+
+  /* Escaped '/', '.' and '+'. */
+  "/%2F",
+  "/%2f",
+  "/a%2Fb",
+  "/a%2F",
+  "/a%2F..%2Fb",
+  "/a/..%2F..%2Fb",
+  "/%2E",
+  "/%2E%2E/etc/passwd",
+  "/a/%2e",
+  "/a/%2E%2E",
+  "/a%2F%2E%2E",
+  "/a+b",
+  "/+",
+  "/+/../c",
+  "/a%2Bb",
+  "/a%20b",
+  "/%41%42%43/",
+
+  /* An escaped NUL ends the path. */
+  "/%00",
+  "/a%00b",
+  "/a/%00/b",
+  "/a/b%00/../c",
+};
+#define NR_PATHS (sizeof paths / sizeof paths[0])
+
+static int failures = 0;
+
+static void
+check (pool pool, const char *path)
+{
+  int comps[MAX_PATH_COMPS];
+  const char *old;
+  char *new;
+  int n, depth;
+
+  old = old_canonicalize (pool, path);
+  depth = old_canonicalize_depth (pool, path);
+
+  new = pstrdup (pool, path);
+  n = canonicalize_path (new, 1, comps, MAX_PATH_COMPS);
+
+  if (n == -1)
+    {
+      if (depth <= MAX_PATH_COMPS)
+	{
+	  fprintf (stderr, "test_canonical: %s: refused, old gave %s\n",
+		   path, old);
+	  failures++;
+	}
+    }
+  else if (depth > MAX_PATH_COMPS)
+    {
+      fprintf (stderr, "test_canonical: %s: has %d components but "
+	       "was not refused\n", path, depth);
+      failures++;
+    }
+  else if (strcmp (old, new) != 0)
+    {
+      fprintf (stderr, "test_canonical: %s: old gave %s, new gave %s\n",
+	       path, old, new);
+      failures++;
+    }
+}
+
+/* Return PREFIX, then N copies of COMP, then SUFFIX. */
+static char *
+repeat (pool pool, const char *prefix, int n, const char *comp,
+	const char *suffix)
+{
+  vector v = new_vector (pool, const char *);
+  int i;
+
+  vector_push_back (v, prefix);
+  for (i = 0; i < n; ++i)
+    vector_push_back (v, comp);
+  vector_push_back (v, suffix);
+
+  return pjoin (pool, v, "");
+}
+
+int
+main ()
+{
+  pool pool = new_subpool (global_pool);
+  char *up;
+  int i, nr = 0;
+
+  for (i = 0; i < NR_PATHS; ++i, ++nr)
+    check (pool, paths[i]);
+
+  /* Paths around the component limit. */
+  for (i = MAX_PATH_COMPS - 1; i <= MAX_PATH_COMPS + 1; ++i, nr += 6)
+    {
+      check (pool, repeat (pool, "", i, "/a", ""));
+      check (pool, repeat (pool, "", i, "/a", "/"));
+      check (pool, repeat (pool, "/", i, "%2Fa", ""));
+      check (pool, repeat (pool, "/x/..", i, "/a/", "."));
+      check (pool, repeat (pool, "", i, "/a/.//", "b"));
+
+      /* Deeper than the limit, then back up to the root. */
+      up = repeat (pool, "", i, "/..", "/b");
+      check (pool, pstrcat (pool, repeat (pool, "", i, "/a", ""), up));
+    }
+
+  /* Much longer than the limit. */
+  check (pool, repeat (pool, "", 10 * MAX_PATH_COMPS, "/a", "/"));
+  check (pool, repeat (pool, "", 10 * MAX_PATH_COMPS, "/../a", ""));
+  nr += 2;
+
+  delete_pool (pool);
+
+  if (failures > 0)
+    {
+      fprintf (stderr, "test_canonical: %d of %d paths differ\n",
+	       failures, nr);
+      exit (1);
+    }
+  printf ("test_canonical: %d paths OK\n", nr);
+  exit (0);
+}
@@ -39,6 +39,10 @@ fi
 
 echo "Using $mode to fetch URLs."
 
+# Tests which look at the response headers need 'nc'.
+nc -h 2>/dev/null
+if [ $? -eq 1 ]; then have_nc=yes; else have_nc=no; fi
+
 tmp=/tmp/rws.$$
 rm -rf $tmp
 mkdir $tmp
@@ -157,6 +161,18 @@ EOF
 	fi
 }
 
+# Raw request function: request (server, port, file)
+# Sends the HTTP request on standard input and saves the response headers
+# and body, with carriage returns removed, in file.
+request()
+{
+	server=$1
+	port=$2
+	file=$3
+
+	nc $server $port | tr -d '\r' > $file
+}
+
 # Fetch the test file.
 fetch localhost $port /index.html $tmp/downloaded
 if grep -q MAGIC-1234 $tmp/downloaded; then :;
@@ -168,6 +184,74 @@ else
 fi
 rm $tmp/downloaded
 
+# Test conditional GET.
+if [ $have_nc = yes ]; then
+	echo "Testing conditional GET."
+	printf 'GET /index.html HTTP/1.0\r\n\r\n' |
+	request localhost $port $tmp/downloaded
+	etag=`sed -n 's/^ETag: *//p' $tmp/downloaded`
+	printf "GET /index.html HTTP/1.0\r\nIf-None-Match: $etag\r\n\r\n" |
+	request localhost $port $tmp/downloaded
+	if [ -n "$etag" ] && grep -q '^HTTP/1\.[01] 304' $tmp/downloaded &&
+	   ! grep -q MAGIC-1234 $tmp/downloaded; then :;
+	else
+		echo "Conditional GET failed!"
+		echo "Look at $tmp/downloaded for clues."
+		kill $rws_pid
+		exit 1
+	fi
+	rm $tmp/downloaded
+
+	echo "Testing byte ranges."
+	printf 'GET /index.html HTTP/1.0\r\nRange: bytes=0-5\r\n\r\n' |
+	request localhost $port $tmp/downloaded
+	if grep -q '^HTTP/1\.[01] 206' $tmp/downloaded &&
+	   grep -q '^Content-Range: bytes 0-5/' $tmp/downloaded &&
+	   grep -q '^Accept-Ranges: bytes' $tmp/downloaded &&
+	   tail -1 $tmp/downloaded | grep -q '^<html>$'; then :;
+	else
+		echo "Byte range request failed!"
+		echo "Look at $tmp/downloaded for clues."
+		kill $rws_pid
+		exit 1
+	fi
+	rm $tmp/downloaded
+
+	echo "Testing pipelined requests."
+	for i in 1 2; do
+		printf 'GET /index.html HTTP/1.1\r\nHost: localhost:%s\r\n\r\n' \
+		    $port
+	done > $tmp/pipeline
+	printf 'GET /index.html HTTP/1.1\r\nHost: localhost:%s\r\nConnection: close\r\n\r\n' \
+	    $port >> $tmp/pipeline
+	request localhost $port $tmp/downloaded < $tmp/pipeline
+	if [ `grep -c '^HTTP/1\.1 200' $tmp/downloaded` -eq 3 ] &&
+	   [ `grep -c MAGIC-1234 $tmp/downloaded` -eq 3 ]; then :;
+	else
+		echo "Pipelined requests failed!"
+		echo "Look at $tmp/downloaded for clues."
+		kill $rws_pid
+		exit 1
+	fi
+	rm $tmp/downloaded $tmp/pipeline
+
+	echo "Testing path canonicalization."
+	for path in //index.html /./index.html /files/../index.html \
+	    /../index.html /%69ndex.html /files/%2e%2e/index.html \
+	    /files/.//../index.html; do
+		printf 'GET %s HTTP/1.0\r\n\r\n' $path |
+		request localhost $port $tmp/downloaded
+		if grep -q MAGIC-1234 $tmp/downloaded; then :;
+		else
+			echo "Fetching $path failed!"
+			echo "Look at $tmp/downloaded for clues."
+			kill $rws_pid
+			exit 1
+		fi
+		rm $tmp/downloaded
+	done
+fi
+
 # Fetch the directory listing.
 fetch localhost $port /files/ $tmp/downloaded
 if grep -q main.o $tmp/downloaded; then :;
@@ -204,6 +288,22 @@ else
 fi
 rm $tmp/downloaded
 
+# A reload with a broken configuration file should keep the old one.
+echo "Testing reload with a bad configuration file."
+cp $tmp/etc/rws/rws.conf $tmp/rws.conf.good
+echo "this line is not valid" >> $tmp/etc/rws/rws.conf
+kill -HUP $rws_pid; sleep 1
+fetch localhost $port /index.html $tmp/downloaded
+if kill -0 $rws_pid && grep -q MAGIC-1234 $tmp/downloaded; then :;
+else
+	echo "Server did not survive a bad configuration file!"
+	echo "Look at $tmp/downloaded and $tmp/log/error_log for clues."
+	kill $rws_pid
+	exit 1
+fi
+rm $tmp/downloaded
+mv $tmp/rws.conf.good $tmp/etc/rws/rws.conf
+
 echo "Test completed OK."
 
 # Kill the server.
@@ -0,0 +1,117 @@
+/* Time of day cache.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+
+#include <pool.h>
+#include <hash.h>
+
+#include <pthr_pseudothread.h>
+
+#include "timecache.h"
+
+/* The time, updated at the start of every second by the thread. This
+ * is 0 until the thread has been started.
+ */
+static time_t now = 0;
+
+/* Maps the number of seconds in an 'expires' setting to struct
+ * timecache_expires *. There are only as many entries as different
+ * settings, so they are never freed.
+ */
+static hash expires_hash = 0;
+
+static void run (void *);
+
+void
+timecache_init ()
+{
+  pseudothread pth;
+
+  time (&now);
+  pth = new_pseudothread (new_subpool (global_pool), run, 0, "timecache");
+  pth_start (pth);
+}
+
+static void
+run (void *vp)
+{
+  struct timeval tv;
+
+  for (;;)
+    {
+      /* Wake up just after the second changes, so the time is never
+       * more than a few milliseconds behind.
+       */
+      gettimeofday (&tv, 0);
+      now = tv.tv_sec;
+      pth_millisleep (1000 - tv.tv_usec / 1000);
+    }
+}
+
+time_t
+timecache_now ()
+{
+  return now ? now : time (0);
+}
+
+const struct timecache_expires *
+timecache_get_expires (int delta)
+{
+  struct timecache_expires *e;
+  time_t t = timecache_now ();
+
+  if (!expires_hash)
+    expires_hash = new_hash (global_pool, int, struct timecache_expires *);
+
+  if (!hash_get (expires_hash, delta, e))
+    {
+      e = pmalloc (global_pool, sizeof *e);
+      e->now = 0;
+      snprintf (e->cache_control, sizeof e->cache_control,
+		"max-age=%d", delta > 0 ? delta : 0);
+      hash_insert (expires_hash, delta, e);
+    }
+
+  /* Remake the header if the time has moved on. */
+  if (e->now != t)
+    {
+      e->now = t;
+      t += delta;
+      strftime (e->expires, sizeof e->expires,
+		"%a, %d %b %Y %H:%M:%S GMT", gmtime (&t));
+    }
+
+  return e;
+}
@@ -0,0 +1,53 @@
+/* Time of day cache.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#ifndef TIMECACHE_H
+#define TIMECACHE_H
+
+#include "config.h"
+
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+
+/* Start the thread which keeps the time up to date. */
+extern void timecache_init (void);
+
+/* The current time, to the nearest second. Before TIMECACHE_INIT is
+ * called this just calls time(2).
+ */
+extern time_t timecache_now (void);
+
+/* Headers for an 'expires' setting of DELTA seconds, which are
+ * remade at most once a second.
+ */
+struct timecache_expires
+{
+  time_t now;			/* When the headers were made. */
+  char expires[32];		/* RFC 1123 date of now + DELTA. */
+  char cache_control[32];	/* "max-age=DELTA" */
+};
+
+/* Return the headers for DELTA at the current time. The result stays
+ * valid, but its contents change when the time moves on.
+ */
+extern const struct timecache_expires *timecache_get_expires (int delta);
+
+#endif /* TIMECACHE_H */
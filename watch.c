@@ -0,0 +1,320 @@
+/* Watch cached files for changes using inotify.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_ALLOCA_H
+#include <alloca.h>
+#endif
+
+#if defined(HAVE_INOTIFY_INIT) && defined(HAVE_SYS_INOTIFY_H)
+#include <sys/inotify.h>
+#define USE_INOTIFY 1
+#endif
+
+#include <pool.h>
+#include <hash.h>
+#include <pstring.h>
+
+#include <pthr_pseudothread.h>
+
+#include "file.h"
+#include "statcache.h"
+#include "watch.h"
+
+#ifdef USE_INOTIFY
+
+/* Events which mean a file in a watched directory has changed. */
+#define WATCH_MASK (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | \
+		    IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+		    IN_DELETE_SELF | IN_MOVE_SELF)
+
+static int watch_fd = -1;
+static pseudothread watch_pth;
+
+/* Set when inotify_add_watch runs out of watches, so we don't keep
+ * asking. Files added after this point are checked the old way.
+ */
+static int watch_full = 0;
+
+/* A watched directory. REFS counts the successful calls to watch_file
+ * for files in it, less the calls to watch_release. The watch is
+ * dropped when it reaches zero.
+ */
+struct dir_watch
+{
+  int wd;
+  int refs;
+};
+
+/* Map watched directory names to watches and back again. These are
+ * allocated in MAP_POOL, which is thrown away whenever we drop all the
+ * watches.
+ */
+static pool map_pool;
+static shash dir_to_wd;
+static hash wd_to_dir;
+
+static void run (void *);
+static void new_maps (void);
+static void forget_all (void);
+static int dir_length (const char *path);
+
+void
+watch_init ()
+{
+  watch_fd = inotify_init ();
+  if (watch_fd == -1)
+    {
+      /* Not fatal: the file cache falls back to checking mtimes. */
+      perror ("inotify_init");
+      return;
+    }
+  if (fcntl (watch_fd, F_SETFD, FD_CLOEXEC) < 0 ||
+      fcntl (watch_fd, F_SETFL, O_NONBLOCK) < 0)
+    { perror ("fcntl"); exit (1); }
+
+  new_maps ();
+
+  watch_pth = new_pseudothread (new_subpool (global_pool), run, 0, "watch");
+  pth_start (watch_pth);
+}
+
+static void
+new_maps ()
+{
+  map_pool = new_subpool (global_pool);
+  dir_to_wd = new_shash (map_pool, struct dir_watch);
+  wd_to_dir = new_hash (map_pool, int, const char *);
+}
+
+/* Return the length of the directory part of PATH, or -1 if it has
+ * none.
+ */
+static int
+dir_length (const char *path)
+{
+  const char *slash;
+
+  slash = strrchr (path, '/');
+  return slash ? slash - path : -1;
+}
+
+int
+watch_file (const char *path)
+{
+  struct dir_watch *w, new_w;
+  char *dir;
+  int len, wd;
+
+  if (watch_fd == -1 || watch_full) return -1;
+
+  if ((len = dir_length (path)) == -1) return -1;
+  dir = alloca (len + 1);
+  memcpy (dir, path, len);
+  dir[len] = '\0';
+
+  shash_get_ptr (dir_to_wd, dir, w);
+  if (w)
+    {
+      w->refs++;
+      return 0;
+    }
+
+  wd = inotify_add_watch (watch_fd, dir, WATCH_MASK);
+  if (wd == -1)
+    {
+      if (errno == ENOSPC)
+	{
+	  fprintf (stderr,
+		   "rws: out of inotify watches, "
+		   "falling back to checking modification times\n");
+	  watch_full = 1;
+	}
+      return -1;
+    }
+
+  /* The same directory under another name (eg. "a//b" and "a/b")
+   * gets the same watch descriptor, but events are only reported
+   * under one name, so don't claim to watch the second one.
+   */
+  if (hash_exists (wd_to_dir, wd))
+    return -1;
+
+  new_w.wd = wd;
+  new_w.refs = 1;
+  shash_insert (dir_to_wd, dir, new_w);
+  dir = pstrdup (map_pool, dir);
+  hash_insert (wd_to_dir, wd, dir);
+
+  return 0;
+}
+
+void
+watch_release (const char *path)
+{
+  struct dir_watch *w;
+  char *dir;
+  int len, wd;
+
+  if (watch_fd == -1) return;
+
+  if ((len = dir_length (path)) == -1) return;
+  dir = alloca (len + 1);
+  memcpy (dir, path, len);
+  dir[len] = '\0';
+
+  /* The watches may all have been dropped since PATH was watched. */
+  shash_get_ptr (dir_to_wd, dir, w);
+  if (!w || --w->refs > 0) return;
+
+  /* Forget the directory before the watch goes, so that the IN_IGNORED
+   * event for it is taken as a straggler.
+   */
+  wd = w->wd;
+  shash_erase (dir_to_wd, dir);
+  hash_erase (wd_to_dir, wd);
+  inotify_rm_watch (watch_fd, wd);
+}
+
+static void
+run (void *vp)
+{
+  char buf[8192]
+    __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+  const struct inotify_event *ev;
+  const char *dir, *path;
+  pool tmp;
+  int n, i;
+
+  pth_set_name ("rws inotify watcher");
+
+  for (;;)
+    {
+      n = pth_read (watch_fd, buf, sizeof buf);
+      if (n <= 0)
+	{
+	  perror ("read: inotify");
+	  forget_all ();
+	  close (watch_fd);
+	  watch_fd = -1;
+	  pth_exit ();
+	}
+
+      tmp = new_subpool (global_pool);
+
+      for (i = 0; i < n; i += sizeof *ev + ev->len)
+	{
+	  ev = (const struct inotify_event *) &buf[i];
+
+	  /* If the kernel dropped events we no longer know what's up to
+	   * date, so throw everything out.
+	   */
+	  if (ev->mask & IN_Q_OVERFLOW)
+	    {
+	      forget_all ();
+	      continue;
+	    }
+
+	  /* Ignore stragglers from watches we have already dropped. */
+	  if (!hash_get (wd_to_dir, ev->wd, dir))
+	    continue;
+
+	  /* The directory itself was removed, renamed or unmounted.
+	   * Renaming a directory changes the path of every file under
+	   * it, so again throw everything out.
+	   */
+	  if (ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF))
+	    {
+	      forget_all ();
+	      continue;
+	    }
+
+	  if (ev->len == 0) continue;
+
+	  path = psprintf (tmp, "%s/%s", dir, ev->name);
+	  file_invalidate_path (path);
+	  statcache_invalidate (path);
+	}
+
+      delete_pool (tmp);
+    }
+}
+
+/* Drop all watches and everything that depended on them. */
+static void
+forget_all ()
+{
+  vector wds;
+  int i, wd;
+
+  wds = hash_keys (wd_to_dir);
+  for (i = 0; i < vector_size (wds); ++i)
+    {
+      vector_get (wds, i, wd);
+      inotify_rm_watch (watch_fd, wd);
+    }
+
+  delete_pool (map_pool);
+  new_maps ();
+  watch_full = 0;
+
+  /* Cache entries made while the watches were in place now have
+   * nothing watching them.
+   */
+  file_flush ();
+  statcache_flush ();
+}
+
+#else /* !USE_INOTIFY */
+
+void
+watch_init ()
+{
+}
+
+int
+watch_file (const char *path)
+{
+  return -1;
+}
+
+void
+watch_release (const char *path)
+{
+}
+
+#endif /* !USE_INOTIFY */
@@ -0,0 +1,45 @@
+/* Watch cached files for changes using inotify.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "config.h"
+
+/* Start the watcher thread. Call this from the server startup
+ * function. Does nothing if the OS doesn't support inotify.
+ */
+extern void watch_init (void);
+
+/* Watch the directory containing PATH, so that the file cache and the
+ * stat cache hear about changes to PATH as soon as they happen. Returns
+ * 0 if PATH is watched, or -1 if it is not (for example, if the limit
+ * on the number of watches has been reached), in which case the caller
+ * must check for changes itself.
+ */
+extern int watch_file (const char *path);
+
+/* Call this once for each successful call to watch_file for PATH when
+ * the caller no longer needs to hear about changes to it. The directory
+ * stops being watched when nothing in it needs watching.
+ */
+extern void watch_release (const char *path);
+
+#endif /* WATCH_H */
@@ -0,0 +1,219 @@
+/* Multi-process mode.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_SIGNAL_H
+#include <signal.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#endif
+
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+
+#include <pool.h>
+
+#include "workers.h"
+
+static int nr_workers;
+static pid_t *workers;		/* Process ID of each worker, or 0. */
+
+static volatile sig_atomic_t reload = 0, quit = 0;
+
+/* Set once the master has passed on a SIGHUP, after which a new worker
+ * can't use the configuration it inherits.
+ */
+static int reloaded = 0;
+
+static sigset_t old_mask;
+
+static int start_worker (int i);
+static void catch_reload_signal (int sig);
+static void catch_quit_signal (int sig);
+static void catch_wake_signal (int sig);
+
+int
+workers_start (int n)
+{
+  struct sigaction sa;
+  sigset_t mask;
+  pid_t pid;
+  time_t restart_at = 0, now;
+  int i, status, waiting;
+
+  nr_workers = n;
+  workers = pmalloc (global_pool, nr_workers * sizeof (pid_t));
+  memset (workers, 0, nr_workers * sizeof (pid_t));
+
+  /* The master only looks at the signals between calls to sigsuspend,
+   * so that none is lost while it is busy. SIGCHLD and SIGALRM just
+   * wake it up.
+   */
+  sigemptyset (&mask);
+  sigaddset (&mask, SIGHUP);
+  sigaddset (&mask, SIGINT);
+  sigaddset (&mask, SIGQUIT);
+  sigaddset (&mask, SIGTERM);
+  sigaddset (&mask, SIGCHLD);
+  sigaddset (&mask, SIGALRM);
+  sigprocmask (SIG_BLOCK, &mask, &old_mask);
+
+  memset (&sa, 0, sizeof sa);
+  sa.sa_handler = catch_reload_signal;
+  sigaction (SIGHUP, &sa, 0);
+
+  sa.sa_handler = catch_quit_signal;
+  sigaction (SIGINT, &sa, 0);
+  sigaction (SIGQUIT, &sa, 0);
+  sigaction (SIGTERM, &sa, 0);
+
+  sa.sa_handler = catch_wake_signal;
+  sigaction (SIGCHLD, &sa, 0);
+  sigaction (SIGALRM, &sa, 0);
+
+  for (i = 0; i < nr_workers; ++i)
+    if (start_worker (i) == 0)
+      return 0;
+
+  for (;;)
+    {
+      if (quit)
+	{
+	  for (i = 0; i < nr_workers; ++i)
+	    if (workers[i]) kill (workers[i], SIGTERM);
+	  while (wait (0) > 0 || errno == EINTR)
+	    ;
+	  exit (0);
+	}
+
+      if (reload)
+	{
+	  reload = 0;
+	  reloaded = 1;
+	  for (i = 0; i < nr_workers; ++i)
+	    if (workers[i]) kill (workers[i], SIGHUP);
+	}
+
+      while ((pid = waitpid (-1, &status, WNOHANG)) > 0)
+	for (i = 0; i < nr_workers; ++i)
+	  if (workers[i] == pid)
+	    {
+	      if (WIFSIGNALED (status))
+		fprintf (stderr, "rws: worker %d killed by signal %d\n",
+			 (int) pid, WTERMSIG (status));
+	      else
+		fprintf (stderr, "rws: worker %d exited with status %d\n",
+			 (int) pid, WEXITSTATUS (status));
+	      workers[i] = 0;
+
+	      /* Pause, in case the worker is dying over and over. */
+	      restart_at = time (0) + 1;
+	    }
+
+      /* Restart workers which have died, once the pause is over. */
+      waiting = 0;
+      time (&now);
+      for (i = 0; i < nr_workers; ++i)
+	if (workers[i] == 0)
+	  {
+	    if (now < restart_at)
+	      waiting = 1;
+	    else if (start_worker (i) == 0)
+	      return reloaded;
+	    else if (workers[i] == 0)
+	      {
+		/* Fork failed. Try again later. */
+		restart_at = now + 1;
+		waiting = 1;
+	      }
+	  }
+      if (waiting)
+	alarm (1);
+
+      sigsuspend (&old_mask);
+    }
+}
+
+/* Fork worker I. Returns 0 in the worker, or the worker's process ID
+ * (or -1 if fork failed) in the master.
+ */
+static int
+start_worker (int i)
+{
+  struct sigaction sa;
+  pid_t pid;
+
+  pid = fork ();
+  if (pid == -1)
+    {
+      perror ("fork");
+      return -1;
+    }
+  if (pid == 0)
+    {
+      /* The caller sets up the other signals again. */
+      memset (&sa, 0, sizeof sa);
+      sa.sa_handler = SIG_DFL;
+      sigaction (SIGALRM, &sa, 0);
+      sigprocmask (SIG_SETMASK, &old_mask, 0);
+      return 0;
+    }
+
+  workers[i] = pid;
+  return pid;
+}
+
+static void
+catch_reload_signal (int sig)
+{
+  reload = 1;
+}
+
+static void
+catch_quit_signal (int sig)
+{
+  quit = 1;
+}
+
+static void
+catch_wake_signal (int sig)
+{
+  /* Nothing to do: the signal just ends sigsuspend. */
+}
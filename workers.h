@@ -0,0 +1,37 @@
+/* Multi-process mode.
+ * - by agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include "config.h"
+
+/* Fork NR_WORKERS worker processes, which all accept connections on
+ * the listening socket inherited from this process. This function
+ * returns only in the workers. The calling process becomes the master:
+ * it passes SIGHUP on to the workers, restarts any which die, and
+ * stops them all when it is told to quit.
+ *
+ * Returns 1 if the configuration has been reloaded since the server
+ * started, so the worker must read it again, otherwise 0.
+ */
+extern int workers_start (int nr_workers);
+
+#endif /* WORKERS_H */